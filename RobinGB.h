@@ -7,7 +7,8 @@ ______      _     _       _____ ______
 \_| \_\___/|_.__/|_|_| |_|\____/\____/
 
 Welcome! Basic usage:
-1. Do #include "RobinGB.h" and add the .c files to your build system.
+1. Do #include "RobinGB.h" and add the .c files to your build system. Optionally,
+   edit robingb_config.h to leave out features you don't need.
 2. Call robingb_init(...) to set the path to your .gb file.
 3. Call robingb_update_screen(...) 60 times per second to run the emulation and get the pixel data for each frame.
 4. Call robingb_press_button(...) and robingb_release_button(...) to convey the player's input to the emulator.
@@ -76,19 +77,62 @@ void robingb_press_button(RobinGB_Button button);
 void robingb_release_button(RobinGB_Button button);
 
 /* Run the emulation and update the screen with this function. screen[] must be
-an array of ROBINGB_SCREEN_WIDTH*ROBINGB_SCREEN_HEIGHT bytes, one byte per
-pixel. Call this 60 times per second to run the game at the correct speed. You
-can implement fast-forwarding by calling it more frequently. */
+an array of ROBINGB_SCREEN_WIDTH*ROBINGB_SCREEN_HEIGHT bytes, one byte per pixel
+(unless you choose another format with robingb_set_pixel_format()). Call this 60
+times per second to run the game at the correct speed. You can implement
+fast-forwarding by calling it more frequently. */
 void robingb_update_screen(uint8_t screen[]);
 /* NOTE: If your platform can't afford to block for the amount of time that
 this function takes, see the lower-level robingb_update_screen_line() function
 at the bottom of this file. */
 
+/* If you don't need audio, pass 0 as the audio_sample_rate to robingb_init(). No
+audio is generated, which saves a lot of time, but the game still sees correctly
+behaving audio hardware. To also leave the audio code out of your binary, define
+ROBINGB_DISABLE_AUDIO in robingb_config.h. Either way, the functions below only
+return silence. */
+
 /* Call this to fill your audio output buffer as and when you need to.
-samples_out[] must be an array of samples_count elements. Stereo audio isn't
-supported for efficiency reasons. */
+samples_out[] must be an array of samples_count elements. This is 8-bit mono;
+see robingb_set_stereo_audio() for stereo. Samples are generated as the emulation runs
+and are buffered until you ask for them, so this function only copies, and it's
+safe to call it from your audio thread while the emulation runs on another. */
 void robingb_get_audio_samples(int8_t samples_out[], uint16_t samples_count);
 
+/* Call this with true after robingb_init() to get 16-bit stereo audio from
+robingb_get_stereo_audio_samples() instead of mono from robingb_get_audio_samples().
+Stereo follows the game's panning and master volume, and costs about 24KB of RAM.
+Returns false if the memory couldn't be allocated. Any buffered samples are
+discarded, so don't call it while your audio thread is reading samples. */
+bool robingb_set_stereo_audio(bool enabled);
+
+/* The stereo version of robingb_get_audio_samples(). samples_out[] must be an array
+of frames_count*2 elements, and is filled with interleaved left and right samples. */
+void robingb_get_stereo_audio_samples(int16_t samples_out[], uint16_t frames_count);
+
+/* The number of samples (or left and right pairs for stereo) currently buffered and
+ready to be read. */
+uint16_t robingb_get_audio_sample_count();
+
+/* Set this to the number of samples your audio output takes per refill, and
+robingb_run_cycles() will report ROBINGB_EVENT_AUDIO_BUFFER_READY whenever at least
+that many are buffered. Call it with 0 to turn the event off, which is the default. */
+void robingb_set_audio_ready_threshold(uint16_t sample_count);
+
+/* The Game Boy runs at about 59.73 frames per second, which doesn't quite match
+your host, so the number of buffered samples slowly drifts. Call this with the
+number of samples you'd like to keep buffered (e.g. audio_sample_rate/30 for two
+frames), and RobinGB will adjust its output rate by up to 0.5% to stay near it.
+The adjustment is too small to hear. Call it with 0 to turn it off, which is the
+default. */
+void robingb_set_audio_rate_control(uint16_t target_sample_count);
+
+/* underrun_count is the number of times robingb_get_audio_samples() was asked for
+more samples than were buffered (the emulation is running too slowly), and
+overrun_count is the number of times samples were dropped because the buffer was
+full (the samples aren't being read quickly enough). Either pointer can be NULL. */
+void robingb_get_audio_stats(uint32_t *underrun_count, uint32_t *overrun_count);
+
 /* Call this before quitting, or more frequently if you prefer, otherwise your
 saves will be lost. The save file will be automatically loaded when you boot
 the game again with robingb_init(). */
@@ -100,10 +144,193 @@ hardware. The screen will appear extremely dark and inverted, so you will need
 to do some additional processing. */
 extern bool robingb_native_pixel_format;
 
+/* Alternatively, RobinGB can render directly into the pixel format of your
+display, which saves you a conversion pass over every frame. The size of screen[]
+depends on the format:
+ROBINGB_PIXEL_FORMAT_8BIT: 1 byte per pixel, as described above. This is the default.
+ROBINGB_PIXEL_FORMAT_RGB565: one uint16_t per pixel, in your platform's byte order.
+ROBINGB_PIXEL_FORMAT_XRGB8888: one uint32_t per pixel.
+ROBINGB_PIXEL_FORMAT_2BPP: 4 pixels per byte (ROBINGB_SCREEN_WIDTH/4 bytes per
+line), leftmost pixel in the highest 2 bits, in the native format described above.
+For the 16 and 32-bit formats, screen[] must be suitably aligned. colors[] is an
+array of 4 0xRRGGBB colors from lightest to darkest, or NULL for greyscale. It is
+ignored by the 8-bit and 2-bit formats. */
+typedef enum {
+    ROBINGB_PIXEL_FORMAT_8BIT,
+    ROBINGB_PIXEL_FORMAT_RGB565,
+    ROBINGB_PIXEL_FORMAT_XRGB8888,
+    ROBINGB_PIXEL_FORMAT_2BPP
+} RobinGB_Pixel_Format;
+
+void robingb_set_pixel_format(RobinGB_Pixel_Format format, const uint32_t colors[]);
+
+/* If you can't spare the RAM for a whole screen[], RobinGB can hand you each line
+as soon as it's rendered instead. first_line_buffer[] must be big enough for one
+line in the current pixel format. Each finished line is written into the current
+buffer and line_ready() is called with it. line_ready() must return the buffer
+to use for the next line, which may be the same one, or the next one in a ring of
+buffers if the previous line is still being sent to your display. While a line
+sink is set, you can pass NULL as screen[] to robingb_update_screen() and
+robingb_update_screen_line(). Pass NULL as line_ready to go back to screen[]. If
+robingb_skip_unchanged_lines is true, line_ready() is only called for lines that
+have changed. */
+void robingb_set_line_sink(uint8_t first_line_buffer[], uint8_t *(*line_ready)(uint8_t screen_line, uint8_t line[]));
+
+/* Set this boolean to true to make RobinGB skip rendering any line whose inputs
+(scroll registers, palettes, tile data, objects etc.) haven't changed since it
+was last rendered. This is useful for displays with limited bandwidth, in
+conjunction with robingb_get_changed_lines() below. screen[] must be the same
+array every time, and its contents must not be modified between frames. */
+extern bool robingb_skip_unchanged_lines;
+
+/* Find out which lines of screen[] have changed since the last call, so that
+only those need to be sent to the display. changed_lines_out[] must be an array
+of ROBINGB_SCREEN_HEIGHT/8 bytes. Line n has changed if bit (n % 8) of
+changed_lines_out[n / 8] is set. Returns false if no lines have changed. If
+robingb_skip_unchanged_lines is false, all lines are reported as changed. */
+bool robingb_get_changed_lines(uint8_t changed_lines_out[]);
+
+/* Call this with true to keep a pre-rendered copy of both 256x256 background
+layers, which are updated as the game changes them. This makes rendering much
+cheaper for most games, but costs 128KB of RAM. Returns false if the memory
+couldn't be allocated. Call it with false to free the memory again. */
+bool robingb_set_background_cache(bool enabled);
+
+/* On hosts with more than one core, rendering can run in parallel with the
+emulation. Call robingb_set_render_queue(true), and RobinGB will only record the
+state of each line instead of rendering it. Then call robingb_render_queued_line()
+repeatedly on another thread or core. It renders one recorded line and returns
+true, or returns false if no lines are waiting. The line_ready() callback of
+robingb_set_line_sink() will be called on the render thread.
+
+The emulation never waits for the render thread. Lines are rendered from a copy
+of the video memory that RobinGB takes whenever the game has changed it, which
+costs about 35KB of RAM while the queue is enabled. If the render thread falls
+too far behind, lines are dropped, and robingb_get_num_dropped_lines() counts
+them. robingb_render_queue_is_empty() returns true once every recorded line has
+been rendered, so check it before reading a complete frame.
+
+robingb_set_render_queue(true) returns false if the memory couldn't be
+allocated. Stop the render thread before calling robingb_set_render_queue(false),
+which renders any remaining lines on the calling thread. Only change the other
+rendering options in this file while the queue is disabled. */
+bool robingb_set_render_queue(bool enabled);
+bool robingb_render_queued_line();
+bool robingb_render_queue_is_empty();
+uint32_t robingb_get_num_dropped_lines();
+
+/* Frameskip, for fast-forwarding or for hosts that can't keep up. Skipped frames
+are fully emulated (timing, interrupts, audio etc.) but not rendered, so they only
+cost CPU emulation time and screen[] keeps the last rendered frame. Set
+robingb_frameskip to N to render one frame out of every N+1. */
+extern uint8_t robingb_frameskip;
+
+/* Alternatively, let RobinGB skip frames only when the host falls behind.
+get_microseconds() must return a timestamp in microseconds (wrapping around is
+fine), microseconds_per_frame is your frame budget (e.g. 16667 for 60Hz), and
+max_frameskip limits the number of consecutive skipped frames. This overrides
+robingb_frameskip. Pass NULL as get_microseconds to turn it off again. */
+void robingb_set_auto_frameskip(uint32_t (*get_microseconds)(), uint32_t microseconds_per_frame, uint8_t max_frameskip);
+
+/* For cooperative schedulers (RTOSes, event loops etc.), this runs the
+emulation for roughly cycle_budget cycles and then returns, so that you can
+interleave it with your own work at any granularity. The Game Boy runs at
+ROBINGB_CYCLES_PER_SECOND, so e.g. 1ms is about 4194 cycles. Emulation stops at
+the end of an instruction, so the number of cycles actually run (the return
+value) can exceed the budget by up to the length of the last instruction, plus
+an interrupt dispatch if one happened right then: a few dozen cycles at most.
+Subtract the excess from your next budget to keep the timing exact. If
+events_out isn't NULL, it is set to a combination of the RobinGB_Event flags
+below, describing what happened during the call. screen[] is as described for
+robingb_update_screen(). */
+#define ROBINGB_CYCLES_PER_SECOND 4194304
+
+typedef enum {
+    ROBINGB_EVENT_LINE_COMPLETED = 0x01, /* at least one visible line was completed */
+    ROBINGB_EVENT_VBLANK = 0x02, /* the V-blank phase was entered, so the frame is complete */
+    ROBINGB_EVENT_AUDIO_BUFFER_READY = 0x04 /* see robingb_set_audio_ready_threshold() */
+} RobinGB_Event;
+
+uint32_t robingb_run_cycles(uint8_t screen[], uint32_t cycle_budget, uint8_t *events_out);
+
+/* The same as robingb_run_cycles(), but with a budget in microseconds of emulated time.
+Fractions of a cycle are carried over to the next call, so many short calls add up to
+the right amount of time. Returns the number of microseconds actually run, rounded down. */
+uint32_t robingb_run_microseconds(uint8_t screen[], uint32_t microseconds, uint8_t *events_out);
+
+/* Instead of polling, you can have RobinGB call you back at the right moments
+of the emulated display timing, e.g. to start display DMA or to top up your audio
+buffer. The callbacks are called from within the emulation functions above:
+vblank_callback() when the V-blank phase is entered (the frame is complete),
+line_callback() when a visible line has been completed, and lyc_callback() when
+LY starts matching the game's LYC register. Pass NULL to unregister a callback.
+Unregistered callbacks cost nothing. */
+void robingb_set_vblank_callback(void (*vblank_callback)());
+void robingb_set_line_callback(void (*line_callback)(uint8_t screen_line));
+void robingb_set_lyc_callback(void (*lyc_callback)(uint8_t ly));
+
+/* RobinGB executes some common pairs of instructions in a single step, such as
+DEC B followed by JR NZ. To see how much a game benefits, this gets the number of
+instruction dispatches since robingb_init() and, for each RobinGB_Fusion_Kind, the
+number of instructions that were executed as the second half of a pair instead of
+needing a dispatch of their own. fused_counts_out[] must be an array of
+ROBINGB_FUSION_KIND_COUNT elements. Either pointer can be NULL. The counts are only
+kept if ROBINGB_ENABLE_INSTRUMENTATION is defined in robingb_config.h, otherwise
+they're all 0. */
+typedef enum {
+    ROBINGB_FUSION_JUMP, /* JR cc after DEC, CP, AND, OR etc. */
+    ROBINGB_FUSION_AND, /* AND x after LDH A,(x) or AND x */
+    ROBINGB_FUSION_COPY, /* LD (DE),A or LD (HL+),A after LD A,(HL+) or LD A,(DE) */
+    ROBINGB_FUSION_KIND_COUNT
+} RobinGB_Fusion_Kind;
+
+void robingb_get_fusion_stats(uint32_t *dispatch_count, uint32_t fused_counts_out[]);
+
+/* If ROBINGB_ENABLE_PROFILER is defined in robingb_config.h, RobinGB samples the
+instruction it's executing every 192 to 319 cycles, and charges it with all the cycles
+since the previous sample. The cycles of each opcode and each instruction address since
+robingb_init() or robingb_reset_profile() are therefore estimates, but they add up to
+the exact total, and samples says how many samples each estimate is made of. Sampling
+costs about 5% of the emulation speed. CB-prefixed opcodes are counted as 0x100 plus the second
+byte. Instructions in the switchable ROM bank also have their bank number, and bank is 0
+for everything else. If the code at an address changes (it can in RAM), each opcode gets
+its own RobinGB_Address_Profile. A pair of instructions that RobinGB executes in one step
+(see robingb_get_fusion_stats()) is charged to the first of the two.
+
+robingb_get_opcode_profile() and robingb_get_address_profile() fill in up to max_count
+elements of profiles_out[], costliest first, and return how many were filled in.
+robingb_write_profile() writes the costliest max_count of each to a file with
+write_file_function_ptr, as readable text or as JSON, and returns false if the file
+couldn't be written. The address table has a fixed size, so a game with very many hot
+addresses will have some counted as "untracked". Cycles skipped by waiting in a
+busy-wait loop aren't counted at all.
+
+Without ROBINGB_ENABLE_PROFILER, nothing is counted, the getters return 0 and
+robingb_write_profile() returns false. */
+typedef struct {
+    uint16_t opcode;
+    uint32_t samples;
+    uint32_t cycles;
+} RobinGB_Opcode_Profile;
+
+typedef struct {
+    uint16_t bank;
+    uint16_t address;
+    uint16_t opcode;
+    uint32_t samples;
+    uint32_t cycles;
+} RobinGB_Address_Profile;
+
+void robingb_reset_profile();
+uint16_t robingb_get_opcode_profile(RobinGB_Opcode_Profile profiles_out[], uint16_t max_count);
+uint16_t robingb_get_address_profile(RobinGB_Address_Profile profiles_out[], uint16_t max_count);
+bool robingb_write_profile(const char *path, bool json, uint16_t max_count);
+
 /* Finally, here is the more complicated, per-line alternative to robingb_update_screen(). */
 bool robingb_update_screen_line(uint8_t screen[], uint8_t *updated_screen_line);
 /* FULL EXPLANATION:
-screen[] must be an array of ROBINGB_SCREEN_WIDTH*ROBINGB_SCREEN_HEIGHT elements.
+screen[] must be an array of ROBINGB_SCREEN_WIDTH*ROBINGB_SCREEN_HEIGHT elements
+(or ROBINGB_SCREEN_WIDTH/4*ROBINGB_SCREEN_HEIGHT bytes for ROBINGB_PIXEL_FORMAT_2BPP).
 This function runs the game and potentially updates one horizontal line of the
 screen. If the function returns true, one line of the screen has been updated
 and the uint8_t pointed by updated_screen_line will be set. Games will usually
@@ -121,6 +348,9 @@ for (uint16_t i = updated_screen_line * ROBINGB_SCREEN_WIDTH;
 NOTE: After a complete screen update, robingb_update_screen_line() will return
 false multiple times during the vertical-blanking phase. You must enter this
 phase 60 times per second for correct emulation speed.
+
+NOTE: Lines of skipped frames (see robingb_frameskip) are still reported, but
+screen[] is left untouched.
 */
 
 #endif /* end include guard */
@@ -1,269 +1,1090 @@
 #include "internal.h"
 
 #include <assert.h>
+#include <stdlib.h>
 #include <string.h>
 
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define ROBINGB_MIX_SSE2
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define ROBINGB_MIX_NEON
+#endif
+
 #define CHANNEL_3_WAVE_PATTERN_LENGTH (32)
 #define CPU_CLOCK_FREQ (4194304)
-#define STEPS_PER_ENVELOPE (16)
-#define PHASE_FULL_PERIOD (4294967296)
+#define CPU_CLOCK_FREQ_BITS (22) /* CPU_CLOCK_FREQ is 2 to the power of this */
 #define MAX_VOLUME (15)
 
 uint16_t SAMPLE_RATE = 0;
 
-static void get_channel_volume_envelope(
-    uint8_t channel, uint8_t *initial_volume, bool *is_increasing, int32_t *step_length_in_cycles) {
+#ifndef ROBINGB_DISABLE_AUDIO
+bool robingb_audio_is_enabled = false;
+#endif
+
+/* The rate that samples are actually generated at. This is SAMPLE_RATE, unless the rate
+control is nudging it to keep the amount of buffered audio steady. It only changes between
+updates. */
+static uint32_t adjusted_sample_rate = 0;
+static uint32_t next_adjusted_sample_rate = 0;
+
+/* ----------------------------------------------- */
+/* Band-limited synthesis                          */
+/* ----------------------------------------------- */
+
+/* Rather than point-sampling each channel's waveform at the output rate, which aliases
+badly, each channel reports the exact cycle at which its output level changes. Each change
+is added to a buffer of deltas at the output rate as a band-limited step (a windowed sinc
+impulse, picked from PHASE_COUNT sub-sample positions). Once a block of samples is ready, the
+deltas are integrated into samples in one pass. The cost depends on the number of level
+changes, not on the output rate.
+
+Times within the current update are in cycles since the update began. block_position is the
+output sample position at that point, in 1/CPU_CLOCK_FREQ samples, so a cycle count converts
+to a sample position with one multiplication and no division. */
+#define PHASE_BITS 5
+#define PHASE_COUNT (1 << PHASE_BITS)
+#define KERNEL_WIDTH 8
+#define KERNEL_UNITY_BITS 15 /* each row of the kernel adds up to 1 << KERNEL_UNITY_BITS */
+#define DELTA_BUFFER_LENGTH 256
+
+static const int16_t step_kernel[PHASE_COUNT][KERNEL_WIDTH] = {
+    {187, -1042, 2493, 29492, 2493, -1042, 187, 0},
+    {160, -865, 1723, 29446, 3315, -1226, 215, 0},
+    {135, -697, 1006, 29310, 4187, -1416, 244, -1},
+    {112, -538, 344, 29082, 5105, -1610, 274, -1},
+    {91, -390, -263, 28767, 6067, -1806, 304, -2},
+    {72, -252, -813, 28364, 7069, -2003, 335, -4},
+    {55, -126, -1307, 27876, 8107, -2197, 365, -5},
+    {39, -12, -1746, 27312, 9176, -2388, 394, -7},
+    {26, 90, -2130, 26668, 10272, -2571, 422, -9},
+    {15, 181, -2461, 25951, 11390, -2744, 447, -11},
+    {5, 260, -2739, 25166, 12524, -2905, 470, -13},
+    {-2, 327, -2967, 24318, 13668, -3051, 490, -15},
+    {-9, 383, -3147, 23414, 14817, -3178, 505, -17},
+    {-13, 429, -3281, 22455, 15964, -3283, 515, -18},
+    {-17, 464, -3372, 21454, 17103, -3363, 519, -20},
+    {-19, 490, -3423, 20410, 18228, -3415, 517, -20},
+    {-20, 508, -3436, 19333, 19331, -3436, 508, -20},
+    {-20, 517, -3415, 18228, 20410, -3423, 490, -19},
+    {-20, 519, -3363, 17103, 21454, -3372, 464, -17},
+    {-18, 515, -3283, 15964, 22455, -3281, 429, -13},
+    {-17, 505, -3178, 14817, 23414, -3147, 383, -9},
+    {-15, 490, -3051, 13668, 24318, -2967, 327, -2},
+    {-13, 470, -2905, 12524, 25166, -2739, 260, 5},
+    {-11, 447, -2744, 11390, 25951, -2461, 181, 15},
+    {-9, 422, -2571, 10272, 26668, -2130, 90, 26},
+    {-7, 394, -2388, 9176, 27312, -1746, -12, 39},
+    {-5, 365, -2197, 8107, 27876, -1307, -126, 55},
+    {-4, 335, -2003, 7069, 28364, -813, -252, 72},
+    {-2, 304, -1806, 6067, 28767, -263, -390, 91},
+    {-1, 274, -1610, 5105, 29082, 344, -538, 112},
+    {-1, 244, -1416, 4187, 29310, 1006, -697, 135},
+    {0, 215, -1226, 3315, 29446, 1723, -865, 160}
+};
+
+#define NUM_CHANNELS 4
+#define AUDIO_BLOCK_LENGTH 128 /* samples are integrated and output this many at a time */
+
+static int32_t mono_deltas[DELTA_BUFFER_LENGTH];
+static int32_t mono_integrator = 0;
+
+/* Each channel adds its steps to its own buffer here. For mono output they all point to
+mono_deltas, so the channels are mixed as the steps are added. */
+static int32_t *channel_deltas[NUM_CHANNELS] = { mono_deltas, mono_deltas, mono_deltas, mono_deltas };
+
+/* The sample position of cycle 0 of the current update, relative to the start of the delta
+buffers. Samples can be output in the middle of a long update, which takes this below 0, and
+cycle * adjusted_sample_rate can overflow. That's fine, because the arithmetic is unsigned and the
+positions of the cycles that are still to be synthesized always fit. */
+static uint32_t block_position = 0;
+static uint32_t num_cycles_synthesized = 0; /* in the current update */
+static uint32_t max_cycles_per_segment = 0; /* so that the deltas fit in the buffers */
+
+static void add_delta(uint8_t channel_index, uint32_t cycle, int16_t delta) {
+    uint32_t position = block_position + cycle * adjusted_sample_rate;
+    int32_t *out = &channel_deltas[channel_index][position >> CPU_CLOCK_FREQ_BITS];
+    const int16_t *kernel = step_kernel[(position >> (CPU_CLOCK_FREQ_BITS - PHASE_BITS)) & (PHASE_COUNT-1)];
     
-    int volume_envelope_address;
+    int i;
+    for (i = 0; i < KERNEL_WIDTH; i++) out[i] += delta * kernel[i];
+}
+
+/* ----------------------------------------------- */
+/* Output                                          */
+/* ----------------------------------------------- */
+
+/* Samples are generated as emulated time advances, and are stored in a single-producer/
+single-consumer ring buffer until the host asks for them. The emulation thread only writes
+num_written and overrun_count, and the host's audio thread only writes num_read and
+underrun_count, so no locks are needed. */
+#define AUDIO_RING_LENGTH 4096 /* must be a power of 2, and no more than 65536 */
+
+static struct {
+    int8_t samples[AUDIO_RING_LENGTH];
+    volatile uint16_t num_written;
+    volatile uint16_t num_read;
+    volatile uint32_t overrun_count;
+    volatile uint32_t underrun_count;
+    int8_t last_sample_read;
+} audio_ring;
+
+/* Stereo output needs a delta buffer per channel, and the integrated levels of each channel
+are mixed once per block according to the panning registers. It's only allocated if the
+host asks for stereo, so mono-only hosts don't pay for it. */
+#define STEREO_LEVEL_SHIFT (KERNEL_UNITY_BITS - 5) /* channel levels become 0 to 480 */
+
+typedef struct {
+    int32_t deltas[NUM_CHANNELS][DELTA_BUFFER_LENGTH];
+    int32_t integrators[NUM_CHANNELS];
+    int16_t levels[NUM_CHANNELS][DELTA_BUFFER_LENGTH];
+    int16_t mixed[DELTA_BUFFER_LENGTH * 2];
+    int16_t left_gains[NUM_CHANNELS];
+    int16_t right_gains[NUM_CHANNELS];
+    int16_t ring_samples[AUDIO_RING_LENGTH * 2];
+    int16_t last_frame_read[2];
+} Stereo_Output;
+
+static Stereo_Output *stereo = NULL;
+
+static void update_stereo_gains() {
+    uint8_t master_volume = robingb_memory[0xff24];
+    uint8_t panning = robingb_memory[0xff25];
+    int16_t left_volume = ((master_volume >> 4) & 0x07) + 1;
+    int16_t right_volume = (master_volume & 0x07) + 1;
     
-    if (channel == 1 ) {
-        volume_envelope_address = 0xff12;
-    } else if (channel == 2) {
-        volume_envelope_address = 0xff17;
-    } else assert(false);
+    uint8_t c;
+    for (c = 0; c < NUM_CHANNELS; c++) {
+        stereo->left_gains[c] = (panning & (0x10 << c)) ? left_volume : 0;
+        stereo->right_gains[c] = (panning & (0x01 << c)) ? right_volume : 0;
+    }
+}
+
+/* Mixes the channel levels into interleaved left and right samples, 8 at a time. The
+levels and mixed buffers are long enough that frames_count can be rounded up. */
+static void mix_stereo(uint16_t frames_count) {
+    const int16_t *left_gains = stereo->left_gains;
+    const int16_t *right_gains = stereo->right_gains;
+    int16_t *out = stereo->mixed;
+    uint16_t i;
     
-    uint8_t envelope_byte = robingb_memory[volume_envelope_address];
+#if defined(ROBINGB_MIX_SSE2)
+    __m128i left_gain_vectors[NUM_CHANNELS];
+    __m128i right_gain_vectors[NUM_CHANNELS];
+    uint8_t c;
     
-    *initial_volume = envelope_byte >> 4; /* can be 0 to 15 */
+    for (c = 0; c < NUM_CHANNELS; c++) {
+        left_gain_vectors[c] = _mm_set1_epi16(left_gains[c]);
+        right_gain_vectors[c] = _mm_set1_epi16(right_gains[c]);
+    }
     
-    *is_increasing = envelope_byte & 0x08;
+    for (i = 0; i < frames_count; i += 8) {
+        __m128i left = _mm_setzero_si128();
+        __m128i right = _mm_setzero_si128();
+        
+        for (c = 0; c < NUM_CHANNELS; c++) {
+            __m128i levels = _mm_loadu_si128((const __m128i*)&stereo->levels[c][i]);
+            left = _mm_add_epi16(left, _mm_mullo_epi16(levels, left_gain_vectors[c]));
+            right = _mm_add_epi16(right, _mm_mullo_epi16(levels, right_gain_vectors[c]));
+        }
+        
+        _mm_storeu_si128((__m128i*)&out[i*2], _mm_unpacklo_epi16(left, right));
+        _mm_storeu_si128((__m128i*)&out[i*2 + 8], _mm_unpackhi_epi16(left, right));
+    }
+#elif defined(ROBINGB_MIX_NEON)
+    for (i = 0; i < frames_count; i += 8) {
+        int16x8x2_t frames;
+        frames.val[0] = vdupq_n_s16(0);
+        frames.val[1] = vdupq_n_s16(0);
+        
+        uint8_t c;
+        for (c = 0; c < NUM_CHANNELS; c++) {
+            int16x8_t levels = vld1q_s16(&stereo->levels[c][i]);
+            frames.val[0] = vmlaq_n_s16(frames.val[0], levels, left_gains[c]);
+            frames.val[1] = vmlaq_n_s16(frames.val[1], levels, right_gains[c]);
+        }
+        
+        vst2q_s16(&out[i*2], frames);
+    }
+#else
+    for (i = 0; i < frames_count; i++) {
+        int16_t left = 0;
+        int16_t right = 0;
+        
+        uint8_t c;
+        for (c = 0; c < NUM_CHANNELS; c++) {
+            left += stereo->levels[c][i] * left_gains[c];
+            right += stereo->levels[c][i] * right_gains[c];
+        }
+        
+        out[i*2] = left;
+        out[i*2 + 1] = right;
+    }
+#endif
+}
+
+static void write_mono_samples_to_ring(uint16_t samples_count, uint16_t num_free) {
+    uint16_t write_index = audio_ring.num_written;
     
-    uint8_t step_size_specifier = envelope_byte & 0x07;
-    *step_length_in_cycles = step_size_specifier * (CPU_CLOCK_FREQ / 64);
+    uint16_t s;
+    for (s = 0; s < samples_count; s++) {
+        mono_integrator += mono_deltas[s];
+        
+        if (s < num_free) {
+            audio_ring.samples[(write_index++) % AUDIO_RING_LENGTH] = mono_integrator >> KERNEL_UNITY_BITS;
+        }
+    }
 }
 
-static void get_channel_freq_and_restart_and_envelope_stop(
-    uint8_t channel, uint16_t *freq, bool *should_restart, bool *should_stop_at_envelope_end) {
+static void write_stereo_samples_to_ring(uint16_t frames_count, uint16_t num_free) {
+    uint16_t write_index, first_part_count;
+    uint8_t c;
+    for (c = 0; c < NUM_CHANNELS; c++) {
+        int32_t integrator = stereo->integrators[c];
+        const int32_t *deltas = stereo->deltas[c];
+        int16_t *levels = stereo->levels[c];
+        
+        uint16_t s;
+        for (s = 0; s < frames_count; s++) {
+            integrator += deltas[s];
+            levels[s] = integrator >> STEREO_LEVEL_SHIFT;
+        }
+        
+        stereo->integrators[c] = integrator;
+    }
+    
+    mix_stereo(frames_count);
     
-    int lower_freq_bits_address;
-    int upper_freq_bits_and_restart_and_stop_address;
+    if (frames_count > num_free) frames_count = num_free;
     
-    if (channel == 1 ) {
-        lower_freq_bits_address = 0xff13;
-        upper_freq_bits_and_restart_and_stop_address = 0xff14;
-    } else if (channel == 2) {
-        lower_freq_bits_address = 0xff18;
-        upper_freq_bits_and_restart_and_stop_address = 0xff19;
-    } else if (channel == 3) {
-        lower_freq_bits_address = 0xff1d;
-        upper_freq_bits_and_restart_and_stop_address = 0xff1e;
-    } else assert(false);
+    /* copy to the ring in up to 2 parts, in case it wraps around */
+    write_index = audio_ring.num_written % AUDIO_RING_LENGTH;
+    first_part_count = AUDIO_RING_LENGTH - write_index;
+    if (first_part_count > frames_count) first_part_count = frames_count;
     
-    uint16_t freq_specifier = robingb_memory[lower_freq_bits_address]; /* lower 8 bits of frequency */
-    uint8_t restart_and_stop_byte = robingb_memory[upper_freq_bits_and_restart_and_stop_address];
-    robingb_memory_write(upper_freq_bits_and_restart_and_stop_address, restart_and_stop_byte & ~0x80); /* reset the restart flag */
+    memcpy(&stereo->ring_samples[write_index * 2], stereo->mixed, first_part_count * 2 * sizeof(int16_t));
+    memcpy(stereo->ring_samples, &stereo->mixed[first_part_count * 2], (frames_count - first_part_count) * 2 * sizeof(int16_t));
+}
+
+/* The emulated Game Boy (about 59.73 frames per second) and the host's audio hardware never
+run at exactly the same speed, so without correction the ring slowly fills up (adding
+latency) or runs dry (crackling). The rate control nudges the rate that samples are
+generated at by up to 1/RATE_CONTROL_MAX_ADJUSTMENT_DIVISOR, which is too small to hear,
+to keep the number of buffered samples near the target. The band-limited synthesis works at
+any rate, so this resamples for free. */
+#define RATE_CONTROL_MAX_ADJUSTMENT_DIVISOR 200 /* 0.5% */
+#define RATE_CONTROL_FILTER_SHIFT 4
+
+static struct {
+    uint16_t target_sample_count; /* 0 means the rate control is off */
+    int32_t filtered_sample_count; /* smoothed, because hosts read in bursts */
+} rate_control;
+
+static void update_rate_control() {
+    int32_t sample_count, max_error, error, max_adjustment;
     
-    freq_specifier |= (restart_and_stop_byte & 0x07) << 8; /* upper 3 bits of frequency */
+    if (rate_control.target_sample_count == 0) return;
     
-    if (channel == 3) *freq = 65536 / (2048 - freq_specifier);
-    else *freq = 131072 / (2048 - freq_specifier);
+    sample_count = (uint16_t)(audio_ring.num_written - audio_ring.num_read);
+    rate_control.filtered_sample_count +=
+        sample_count - (rate_control.filtered_sample_count >> RATE_CONTROL_FILTER_SHIFT);
     
-    *should_restart = restart_and_stop_byte & 0x80;
-    *should_stop_at_envelope_end = restart_and_stop_byte & 0x40; /* TODO: untested */
+    /* The full adjustment is reached when the error is a quarter of the target. */
+    max_error = rate_control.target_sample_count / 4 + 1;
+    error = rate_control.target_sample_count - (rate_control.filtered_sample_count >> RATE_CONTROL_FILTER_SHIFT);
+    if (error > max_error) error = max_error;
+    else if (error < -max_error) error = -max_error;
+    
+    max_adjustment = SAMPLE_RATE / RATE_CONTROL_MAX_ADJUSTMENT_DIVISOR;
+    next_adjusted_sample_rate = SAMPLE_RATE + max_adjustment * error / max_error;
 }
 
-struct {
-    uint16_t volume;
+/* Integrates the first samples_count samples of the delta buffers into the ring. */
+static void output_samples(uint16_t samples_count) {
+    uint16_t num_free = AUDIO_RING_LENGTH - (uint16_t)(audio_ring.num_written - audio_ring.num_read);
+    uint8_t c;
     
-    /* Where we would normally use a float wraps around at 2*M_PI, I use an unsigned 32-bit int.
-    This is more efficient as it auto-wraps, and float calculations are slow without an FPU. */
-    uint32_t phase; 
-    uint16_t frequency;
-    uint64_t num_cycles_since_restart; // TODO: Avoid 64 bit?
-} channel_1;
-
-static void handle_channel_1_sweep(uint32_t num_cycles) {
+    if (stereo) write_stereo_samples_to_ring(samples_count, num_free);
+    else write_mono_samples_to_ring(samples_count, num_free);
+    
+    if (samples_count > num_free) {
+        /* The host isn't reading samples quickly enough, so the newest ones were dropped. */
+        audio_ring.overrun_count++;
+        robingb_memory_barrier();
+        audio_ring.num_written += num_free;
+    } else {
+        robingb_memory_barrier();
+        audio_ring.num_written += samples_count;
+    }
     
-    uint32_t step_interval_in_cycles;
+    /* Keep the tails of the steps that extend past these samples. */
+    for (c = 0; c < NUM_CHANNELS; c++) {
+        int32_t *deltas = channel_deltas[c];
+        if (c > 0 && deltas == channel_deltas[0]) break; /* mono */
+        
+        memmove(deltas, &deltas[samples_count], KERNEL_WIDTH * sizeof(deltas[0]));
+        memset(&deltas[KERNEL_WIDTH], 0, samples_count * sizeof(deltas[0]));
+    }
+    
+    block_position -= samples_count << CPU_CLOCK_FREQ_BITS;
+    
+    update_rate_control();
+}
+
+/* ----------------------------------------------- */
+/* Channels                                        */
+/* ----------------------------------------------- */
+
+/* Channel state only changes when a channel's registers are written, or when the frame
+sequencer steps (every CYCLES_PER_FRAME_SEQUENCER_STEP cycles) to clock the length
+counters, the sweep, and the envelopes. Between those points the channels only need to run
+their timers, so nothing is recomputed per update. */
+#define CYCLES_PER_FRAME_SEQUENCER_STEP (CPU_CLOCK_FREQ / 512)
+
+static uint8_t frame_sequencer_step = 0;
+static uint32_t cycles_until_frame_sequencer_step = CYCLES_PER_FRAME_SEQUENCER_STEP;
+
+typedef struct {
+    bool is_on;
+    bool length_is_enabled;
+    uint16_t length_remaining;
+} Channel_Length;
+
+typedef struct {
+    uint8_t volume;
     bool is_increasing;
-    uint8_t step_amount_divider;
-    {
-        uint8_t sweep_byte = robingb_memory[0xff10];
-        uint8_t time_index = (sweep_byte >> 4) & 0x07;
+    uint8_t period; /* in frame sequencer envelope steps. 0 means the envelope is stopped. */
+    uint8_t timer;
+} Channel_Envelope;
+
+/* The square channels step through 8 duty positions per period. */
+static const uint8_t duty_patterns[4] = { 0x01, 0x81, 0x87, 0x7e };
+
+typedef struct {
+    Channel_Length length;
+    Channel_Envelope envelope;
+    uint16_t freq_specifier;
+    uint8_t duty_pattern;
+    uint8_t duty_position;
+    uint32_t cycles_per_duty_step;
+    uint32_t cycles_until_next_duty_step;
+    int8_t output; /* the level last reported to the band-limited synthesis */
+} Square_Channel;
+
+static Square_Channel channel_1;
+static Square_Channel channel_2;
+
+static struct {
+    uint8_t period;
+    uint8_t timer;
+    bool is_enabled;
+    uint16_t shadow_freq_specifier;
+} channel_1_sweep;
+
+static struct {
+    Channel_Length length;
+    uint16_t freq_specifier;
+    uint8_t wave_position;
+    uint32_t cycles_per_wave_step;
+    uint32_t cycles_until_next_wave_step;
+    int8_t output;
+    int8_t wave_pattern[CHANNEL_3_WAVE_PATTERN_LENGTH]; /* with the volume shift applied */
+} channel_3;
+
+/* The noise channel's output is the inverted lowest bit of a linear feedback shift register.
+The LFSR always starts from the same state and has no other input, so its output is a fixed
+sequence of bits: 32767 steps long in 15-bit mode and 127 steps long in 7-bit mode. Both
+sequences are generated once into tables, and the channel only keeps its position in the
+current sequence. The tables are followed by a copy of their first 64 bits, so that 32 bits
+can be read from any position without wrapping. */
+#define LFSR_15_BIT_PERIOD 32767
+#define LFSR_7_BIT_PERIOD 127
+
+static uint32_t lfsr_15_bit_table[(LFSR_15_BIT_PERIOD + 64 + 31) / 32];
+static uint32_t lfsr_7_bit_table[(LFSR_7_BIT_PERIOD + 64 + 31) / 32];
+
+static struct {
+    Channel_Length length;
+    Channel_Envelope envelope;
+    bool lfsr_is_7_bit;
+    uint16_t lfsr_period;
+    uint16_t lfsr_position;
+    uint32_t cycles_per_lfsr_step; /* 0 means the LFSR isn't clocked */
+    uint32_t cycles_until_next_lfsr_step;
+    int8_t output;
+} channel_4;
+
+static void build_lfsr_table(uint32_t table[], uint16_t period, bool is_7_bit) {
+    uint16_t lfsr = 0x7fff;
+    uint32_t i;
+    
+    memset(table, 0, ((period + 64 + 31) / 32) * sizeof(table[0]));
+    
+    for (i = 0; i < period; i++) {
+        uint16_t feedback = (lfsr ^ (lfsr >> 1)) & 0x01;
         
-        if (time_index == 0) return; /* sweeping is disabled */
+        if ((lfsr & 0x01) == 0) table[i / 32] |= 0x01u << (i % 32);
         
-        step_interval_in_cycles = time_index * (CPU_CLOCK_FREQ / 128);
-        is_increasing = !((sweep_byte >> 3) & 0x01);
-        step_amount_divider = 1 << (sweep_byte & 0x07);
+        lfsr = (lfsr >> 1) | (feedback << 14);
+        if (is_7_bit) lfsr = (lfsr & ~0x40) | (feedback << 6);
     }
     
-    /* sweeping is enabled */
+    for (i = 0; i < 64; i++) {
+        uint32_t source_bit = (table[(i % period) / 32] >> ((i % period) % 32)) & 0x01;
+        table[(period + i) / 32] |= source_bit << ((period + i) % 32);
+    }
+}
+
+/* Returns the 32 outputs starting at position, with the first in the lowest bit. */
+static uint32_t read_lfsr_bits(const uint32_t table[], uint16_t position) {
+    uint8_t offset = position % 32;
+    const uint32_t *word = &table[position / 32];
+    
+    if (offset == 0) return word[0];
+    else return (word[0] >> offset) | (word[1] << (32 - offset));
+}
+
+static void clock_length(Channel_Length *length) {
+    if (length->length_is_enabled && length->length_remaining > 0) {
+        if (--length->length_remaining == 0) length->is_on = false;
+    }
+}
+
+static void clock_envelope(Channel_Envelope *envelope) {
+    if (envelope->period == 0) return;
+    if (--envelope->timer > 0) return;
+    
+    envelope->timer = envelope->period;
+    
+    if (envelope->is_increasing) {
+        if (envelope->volume < MAX_VOLUME) envelope->volume++;
+    } else {
+        if (envelope->volume > 0) envelope->volume--;
+    }
+}
+
+static void set_envelope(Channel_Envelope *envelope, uint8_t envelope_byte) {
+    envelope->volume = envelope_byte >> 4; /* can be 0 to 15 */
+    envelope->is_increasing = envelope_byte & 0x08;
+    envelope->period = envelope_byte & 0x07;
+    envelope->timer = envelope->period;
+}
+
+static void set_square_channel_freq_specifier(Square_Channel *channel, uint16_t freq_specifier) {
+    channel->freq_specifier = freq_specifier;
+    channel->cycles_per_duty_step = (2048 - freq_specifier) * 4;
+}
+
+static uint16_t calculate_swept_freq_specifier() {
+    uint8_t sweep_byte = robingb_memory[0xff10];
+    uint16_t delta = channel_1_sweep.shadow_freq_specifier >> (sweep_byte & 0x07);
+    
+    if (sweep_byte & 0x08) return channel_1_sweep.shadow_freq_specifier - delta;
+    else return channel_1_sweep.shadow_freq_specifier + delta; /* can be more than 2047, which switches the channel off */
+}
+
+static void clock_channel_1_sweep() {
+    uint16_t freq_specifier;
     
-    uint8_t num_steps = channel_1.num_cycles_since_restart / step_interval_in_cycles;
+    if (channel_1_sweep.timer == 0 || --channel_1_sweep.timer > 0) return;
     
-    uint16_t frequency_delta = (channel_1.frequency / step_amount_divider) * num_steps;
+    channel_1_sweep.timer = channel_1_sweep.period ? channel_1_sweep.period : 8;
+    if (!channel_1_sweep.is_enabled || channel_1_sweep.period == 0) return;
     
-    if (is_increasing) channel_1.frequency += frequency_delta;
-    else channel_1.frequency -= frequency_delta;
+    freq_specifier = calculate_swept_freq_specifier();
+    
+    if (freq_specifier > 2047) {
+        channel_1.length.is_on = false;
+    } else if (robingb_memory[0xff10] & 0x07) {
+        channel_1_sweep.shadow_freq_specifier = freq_specifier;
+        set_square_channel_freq_specifier(&channel_1, freq_specifier);
+        
+        /* The new frequency is visible in the registers */
+        robingb_memory[0xff13] = freq_specifier & 0xff;
+        robingb_memory[0xff14] = (robingb_memory[0xff14] & 0xf8) | (freq_specifier >> 8);
+        
+        /* The next frequency is checked for overflow straight away */
+        if (calculate_swept_freq_specifier() > 2047) channel_1.length.is_on = false;
+    }
 }
 
-static void update_channel_1(uint32_t num_cycles) {
+static void update_status_register() {
+    uint8_t status = robingb_memory[0xff26] & 0x80;
     
-    uint8_t initial_volume;
-    bool volume_is_increasing;
-    int32_t envelope_step_length_in_cycles;
-    get_channel_volume_envelope(
-        1,
-        &initial_volume,
-        &volume_is_increasing,
-        &envelope_step_length_in_cycles);
+    if (channel_1.length.is_on) status |= 0x01;
+    if (channel_2.length.is_on) status |= 0x02;
+    if (channel_3.length.is_on) status |= 0x04;
+    if (channel_4.length.is_on) status |= 0x08;
     
-    bool should_restart;
-    bool should_stop_at_envelope_end;
-    get_channel_freq_and_restart_and_envelope_stop(
-        1,
-        &channel_1.frequency,
-        &should_restart,
-        &should_stop_at_envelope_end);
+    robingb_memory[0xff26] = status | 0x70; /* unused bits read as 1 */
+}
+
+static void step_frame_sequencer() {
+    if ((frame_sequencer_step & 0x01) == 0) {
+        clock_length(&channel_1.length);
+        clock_length(&channel_2.length);
+        clock_length(&channel_3.length);
+        clock_length(&channel_4.length);
+    }
+    
+    if (frame_sequencer_step == 2 || frame_sequencer_step == 6) clock_channel_1_sweep();
     
-    if (should_restart) {
-        channel_1.num_cycles_since_restart = 0;
+    if (frame_sequencer_step == 7) {
+        clock_envelope(&channel_1.envelope);
+        clock_envelope(&channel_2.envelope);
+        clock_envelope(&channel_4.envelope);
     }
     
-    handle_channel_1_sweep(num_cycles);
+    frame_sequencer_step = (frame_sequencer_step + 1) % 8;
+    update_status_register();
+}
+
+static void synthesize_square_channel(Square_Channel *channel, uint8_t channel_index, uint32_t start_cycle, uint32_t end_cycle) {
+    uint32_t cycle = start_cycle;
     
-    /* Modify the volume according to the envelope */
-    channel_1.volume = initial_volume;
+    if (!channel->length.is_on) {
+        /* The channel's timer doesn't run while it's off, so only its output needs updating. */
+        if (channel->output != 0) {
+            add_delta(channel_index, start_cycle, -channel->output);
+            channel->output = 0;
+        }
+        return;
+    }
     
-    if (envelope_step_length_in_cycles != 0) {
-        uint32_t current_step = channel_1.num_cycles_since_restart / envelope_step_length_in_cycles;
+    for (;;) {
+        int8_t output = (channel->duty_pattern & (0x80 >> channel->duty_position)) ? channel->envelope.volume : 0;
+        
+        if (output != channel->output) {
+            add_delta(channel_index, cycle, output - channel->output);
+            channel->output = output;
+        }
         
-        if (volume_is_increasing) channel_1.volume += current_step;
-        else channel_1.volume -= current_step;
+        if (cycle + channel->cycles_until_next_duty_step >= end_cycle) break;
         
-        if (channel_1.volume > MAX_VOLUME) channel_1.volume = 0;
+        cycle += channel->cycles_until_next_duty_step;
+        channel->cycles_until_next_duty_step = channel->cycles_per_duty_step;
+        channel->duty_position = (channel->duty_position + 1) % 8;
     }
     
-    channel_1.num_cycles_since_restart += num_cycles;
+    channel->cycles_until_next_duty_step -= end_cycle - cycle;
 }
 
-struct {
-    uint16_t volume;
-    uint32_t phase;
-    uint16_t frequency;
-    uint64_t num_cycles_since_restart; // TODO: Avoid 64 bit?
-} channel_2;
+static void synthesize_channel_3(uint32_t start_cycle, uint32_t end_cycle) {
+    uint32_t cycle = start_cycle;
+    
+    if (!channel_3.length.is_on) {
+        if (channel_3.output != 0) {
+            add_delta(2, start_cycle, -channel_3.output);
+            channel_3.output = 0;
+        }
+        return;
+    }
+    
+    for (;;) {
+        int8_t output = channel_3.wave_pattern[channel_3.wave_position];
+        
+        if (output != channel_3.output) {
+            add_delta(2, cycle, output - channel_3.output);
+            channel_3.output = output;
+        }
+        
+        if (cycle + channel_3.cycles_until_next_wave_step >= end_cycle) break;
+        
+        cycle += channel_3.cycles_until_next_wave_step;
+        channel_3.cycles_until_next_wave_step = channel_3.cycles_per_wave_step;
+        channel_3.wave_position = (channel_3.wave_position + 1) % CHANNEL_3_WAVE_PATTERN_LENGTH;
+    }
+    
+    channel_3.cycles_until_next_wave_step -= end_cycle - cycle;
+}
 
-static void update_channel_2(uint32_t num_cycles) {
+static void synthesize_channel_4(uint32_t start_cycle, uint32_t end_cycle) {
+    const uint32_t *lfsr_table = channel_4.lfsr_is_7_bit ? lfsr_7_bit_table : lfsr_15_bit_table;
+    int8_t volume = channel_4.envelope.volume;
+    int8_t output = 0;
+    uint32_t num_cycles, cycle, num_steps;
+    
+    if (channel_4.length.is_on) {
+        output = (read_lfsr_bits(lfsr_table, channel_4.lfsr_position) & 0x01) ? volume : 0;
+    }
+    
+    if (output != channel_4.output) {
+        add_delta(3, start_cycle, output - channel_4.output);
+        channel_4.output = output;
+    }
     
-    uint8_t initial_volume;
-    bool volume_is_increasing;
-    int32_t envelope_step_length_in_cycles;
-    get_channel_volume_envelope(
-        2,
-        &initial_volume,
-        &volume_is_increasing,
-        &envelope_step_length_in_cycles);
+    if (!channel_4.length.is_on || channel_4.cycles_per_lfsr_step == 0) return;
     
-    bool should_restart;
-    bool should_stop_at_envelope_end;
-    get_channel_freq_and_restart_and_envelope_stop(
-        2,
-        &channel_2.frequency,
-        &should_restart,
-        &should_stop_at_envelope_end);
+    num_cycles = end_cycle - start_cycle;
     
-    if (should_restart) {
-        channel_2.num_cycles_since_restart = 0;
+    if (channel_4.cycles_until_next_lfsr_step > num_cycles) {
+        channel_4.cycles_until_next_lfsr_step -= num_cycles;
+        return;
     }
     
-    channel_2.volume = initial_volume;
+    /* Count the steps in this segment, and find when the first one happens. */
+    cycle = start_cycle + channel_4.cycles_until_next_lfsr_step;
+    num_steps = 1 + (end_cycle - cycle) / channel_4.cycles_per_lfsr_step;
+    channel_4.cycles_until_next_lfsr_step =
+        channel_4.cycles_per_lfsr_step - (end_cycle - cycle) % channel_4.cycles_per_lfsr_step;
     
-    /* Set the current volume according to the envelope */
-    if (envelope_step_length_in_cycles != 0) {
-        uint32_t current_step = channel_2.num_cycles_since_restart / envelope_step_length_in_cycles;
+    /* Handle up to 32 steps at a time. Only the steps that change the output need any work,
+    and they're the set bits in each output bit XORed with the previous output bit. */
+    while (num_steps > 0) {
+        uint32_t outputs = read_lfsr_bits(lfsr_table, channel_4.lfsr_position);
+        uint32_t next_outputs = read_lfsr_bits(lfsr_table, channel_4.lfsr_position + 1);
+        uint32_t changes = outputs ^ next_outputs;
+        uint8_t num_steps_this_word = num_steps < 32 ? num_steps : 32;
+        uint8_t step;
+        
+        if (num_steps_this_word < 32) changes &= (0x01u << num_steps_this_word) - 1;
         
-        if (volume_is_increasing) channel_2.volume += current_step;
-        else channel_2.volume -= current_step;
+        for (step = 0; changes; step++, changes >>= 1) {
+            int8_t delta;
+            if ((changes & 0x01) == 0) continue;
+            
+            delta = channel_4.output ? -volume : volume;
+            add_delta(3, cycle + step * channel_4.cycles_per_lfsr_step, delta);
+            channel_4.output += delta;
+        }
         
-        if (channel_2.volume > MAX_VOLUME) channel_2.volume = 0;
+        cycle += num_steps_this_word * channel_4.cycles_per_lfsr_step;
+        num_steps -= num_steps_this_word;
+        channel_4.lfsr_position = (channel_4.lfsr_position + num_steps_this_word) % channel_4.lfsr_period;
     }
-    
-    channel_2.num_cycles_since_restart += num_cycles;
 }
 
-struct {
-    uint16_t frequency;
-    uint32_t phase;
-    int8_t wave_pattern[CHANNEL_3_WAVE_PATTERN_LENGTH];
-} channel_3;
+static uint16_t count_finished_samples() {
+    return (block_position + num_cycles_synthesized * adjusted_sample_rate) >> CPU_CLOCK_FREQ_BITS;
+}
 
-static void get_channel_3_wave_pattern(int8_t pattern_out[]) {
-    bool channel_enabled = robingb_memory[0xff1a] & 0x80;
-    uint8_t volume_byte = (robingb_memory[0xff1c] & 0x60) >> 5;
+/* Brings the synthesis up to end_cycle of the current update, stepping the frame
+sequencer at its deadlines along the way. Long updates are split into segments that fit
+in the delta buffers, and each finished block of samples is output straight away. */
+static void synthesize_until(uint32_t end_cycle) {
+    if (max_cycles_per_segment == 0) return; /* robingb_audio_init() hasn't been called yet */
     
+    while (num_cycles_synthesized < end_cycle) {
+        uint32_t segment_end = end_cycle;
         
-    if (channel_enabled && volume_byte) {
-        volume_byte -= 1;
+        if (end_cycle - num_cycles_synthesized > max_cycles_per_segment) {
+            segment_end = num_cycles_synthesized + max_cycles_per_segment;
+        }
         
-        int i;
-        for (i = 0; i < CHANNEL_3_WAVE_PATTERN_LENGTH; i += 2) {
-            uint8_t value = robingb_memory[0xff30 + i/2];
-            
-            pattern_out[i] = (value & 0xf0) >> (4 + volume_byte);
-            pattern_out[i+1] = (value & 0x0f) >> volume_byte;
+        if (segment_end - num_cycles_synthesized >= cycles_until_frame_sequencer_step) {
+            segment_end = num_cycles_synthesized + cycles_until_frame_sequencer_step;
         }
-    } else memset(pattern_out, 0, CHANNEL_3_WAVE_PATTERN_LENGTH);
+        
+        synthesize_square_channel(&channel_1, 0, num_cycles_synthesized, segment_end);
+        synthesize_square_channel(&channel_2, 1, num_cycles_synthesized, segment_end);
+        synthesize_channel_3(num_cycles_synthesized, segment_end);
+        synthesize_channel_4(num_cycles_synthesized, segment_end);
+        
+        cycles_until_frame_sequencer_step -= segment_end - num_cycles_synthesized;
+        num_cycles_synthesized = segment_end;
+        
+        if (cycles_until_frame_sequencer_step == 0) {
+            cycles_until_frame_sequencer_step = CYCLES_PER_FRAME_SEQUENCER_STEP;
+            step_frame_sequencer();
+        }
+        
+        if (count_finished_samples() >= AUDIO_BLOCK_LENGTH) output_samples(count_finished_samples());
+    }
 }
 
-static void update_channel_3(uint32_t num_cycles) {
+/* With audio off, nothing is synthesized and the audio isn't updated every line. The frame
+sequencer still has to run so that length counters and sweeps switch channels off, and NR52
+reads correctly, but it only needs to catch up when the game accesses the registers. */
+static void run_frame_sequencer_until(uint32_t end_cycle) {
+    /* unsigned, so this is correct even if the cycle count has wrapped around */
+    uint32_t num_cycles = end_cycle - num_cycles_synthesized;
     
-    get_channel_3_wave_pattern(channel_3.wave_pattern);
+    while (num_cycles >= cycles_until_frame_sequencer_step) {
+        num_cycles -= cycles_until_frame_sequencer_step;
+        cycles_until_frame_sequencer_step = CYCLES_PER_FRAME_SEQUENCER_STEP;
+        step_frame_sequencer();
+    }
     
-    bool should_restart;
-    bool should_stop_at_envelope_end;
-    get_channel_freq_and_restart_and_envelope_stop(
-        3,
-        &channel_3.frequency,
-        &should_restart,
-        &should_stop_at_envelope_end);
+    cycles_until_frame_sequencer_step -= num_cycles;
+    num_cycles_synthesized = end_cycle;
 }
 
-void robingb_audio_init(uint32_t sample_rate) {
-    SAMPLE_RATE = sample_rate;
+uint32_t robingb_audio_cycles_until_next_event() {
+    /* the cycles since the last update that haven't been synthesized yet */
+    uint32_t num_cycles_pending = robingb_num_cycles_since_audio_update - num_cycles_synthesized;
     
-    /* Test for unsigned wraparound */
-    uint32_t wrapper = 0;
-    wrapper += PHASE_FULL_PERIOD + 1;
+    if (num_cycles_pending >= cycles_until_frame_sequencer_step) return 0;
+    return cycles_until_frame_sequencer_step - num_cycles_pending;
+}
+
+static void catch_up() {
+    if (robingb_audio_is_enabled) synthesize_until(robingb_num_cycles_since_audio_update);
+    else run_frame_sequencer_until(robingb_num_cycles_since_audio_update);
+}
+
+/* ----------------------------------------------- */
+/* Register writes                                 */
+/* ----------------------------------------------- */
+
+static void trigger_square_channel(Square_Channel *channel, uint16_t envelope_address) {
+    channel->length.is_on = robingb_memory[envelope_address] & 0xf8; /* the DAC must be on */
+    if (channel->length.length_remaining == 0) channel->length.length_remaining = 64;
     
-    if (wrapper != 1) {
-        /* TODO: Report that the platform doesn't wraparound unsigned ints. */
-    }
+    set_envelope(&channel->envelope, robingb_memory[envelope_address]);
+    channel->cycles_until_next_duty_step = channel->cycles_per_duty_step;
 }
 
-void robingb_audio_update(uint32_t num_cycles) {
-    update_channel_1(num_cycles);
-    update_channel_2(num_cycles);
-    update_channel_3(num_cycles);
-    /* update_channel_4(num_cycles); */
+static void trigger_channel_1_sweep() {
+    uint8_t sweep_byte = robingb_memory[0xff10];
+    
+    channel_1_sweep.shadow_freq_specifier = channel_1.freq_specifier;
+    channel_1_sweep.period = (sweep_byte >> 4) & 0x07;
+    channel_1_sweep.timer = channel_1_sweep.period ? channel_1_sweep.period : 8;
+    channel_1_sweep.is_enabled = channel_1_sweep.period || (sweep_byte & 0x07);
+    
+    if ((sweep_byte & 0x07) && calculate_swept_freq_specifier() > 2047) channel_1.length.is_on = false;
 }
 
-void robingb_get_audio_samples(int8_t samples_out[], uint16_t samples_count) {
+static void trigger_channel_3() {
+    channel_3.length.is_on = robingb_memory[0xff1a] & 0x80; /* the DAC must be on */
+    if (channel_3.length.length_remaining == 0) channel_3.length.length_remaining = 256;
+    
+    channel_3.wave_position = 0;
+    channel_3.cycles_until_next_wave_step = channel_3.cycles_per_wave_step;
+}
+
+static void trigger_channel_4() {
+    channel_4.length.is_on = robingb_memory[0xff21] & 0xf8; /* the DAC must be on */
+    if (channel_4.length.length_remaining == 0) channel_4.length.length_remaining = 64;
     
-    const uint32_t CHANNEL_1_PHASE_INCREMENT = (PHASE_FULL_PERIOD / SAMPLE_RATE) * channel_1.frequency;
-    const uint32_t CHANNEL_2_PHASE_INCREMENT = (PHASE_FULL_PERIOD / SAMPLE_RATE) * channel_2.frequency;
-    const uint32_t CHANNEL_3_PHASE_INCREMENT = (PHASE_FULL_PERIOD / SAMPLE_RATE) * channel_3.frequency;
+    set_envelope(&channel_4.envelope, robingb_memory[0xff21]);
+    channel_4.lfsr_position = 0;
+    channel_4.cycles_until_next_lfsr_step = channel_4.cycles_per_lfsr_step;
+}
+
+static void set_channel_4_lfsr_from_register(uint8_t value) {
+    uint8_t shift = value >> 4;
+    uint8_t divisor_code = value & 0x07;
     
-    int s;
+    channel_4.lfsr_is_7_bit = value & 0x08;
+    channel_4.lfsr_period = channel_4.lfsr_is_7_bit ? LFSR_7_BIT_PERIOD : LFSR_15_BIT_PERIOD;
     
-    for (s = 0; s < samples_count; s++) {
-        samples_out[s] = (channel_1.phase < PHASE_FULL_PERIOD/2) ? 0 : channel_1.volume;
-        channel_1.phase += CHANNEL_1_PHASE_INCREMENT;
-        
-        if (channel_2.phase < PHASE_FULL_PERIOD/2) samples_out[s] += channel_2.volume;
-        channel_2.phase += CHANNEL_2_PHASE_INCREMENT;
+    channel_4.lfsr_position %= channel_4.lfsr_period;
+    
+    if (shift >= 14) channel_4.cycles_per_lfsr_step = 0;
+    else channel_4.cycles_per_lfsr_step = (divisor_code ? divisor_code * 16 : 8) << shift;
+    
+    if (channel_4.cycles_until_next_lfsr_step == 0 || channel_4.cycles_until_next_lfsr_step > channel_4.cycles_per_lfsr_step) {
+        channel_4.cycles_until_next_lfsr_step = channel_4.cycles_per_lfsr_step;
+    }
+}
+
+static void update_channel_3_wave_pattern(uint16_t first_address, uint16_t end_address) {
+    static const uint8_t volume_shifts[4] = { 4, 0, 1, 2 }; /* mute, 100%, 50%, 25% */
+    uint8_t volume_shift = volume_shifts[(robingb_memory[0xff1c] >> 5) & 0x03];
+    
+    uint16_t address;
+    for (address = first_address; address < end_address; address++) {
+        uint8_t value = robingb_memory[address];
+        int8_t *pattern = &channel_3.wave_pattern[(address - 0xff30) * 2];
         
-        samples_out[s] += channel_3.wave_pattern[channel_3.phase >> 27];
-        channel_3.phase += CHANNEL_3_PHASE_INCREMENT;
+        pattern[0] = (value >> 4) >> volume_shift;
+        pattern[1] = (value & 0x0f) >> volume_shift;
     }
 }
 
+static void set_square_channel_freq_specifier_from_registers(Square_Channel *channel, uint16_t lower_address) {
+    set_square_channel_freq_specifier(
+        channel, robingb_memory[lower_address] | ((robingb_memory[lower_address+1] & 0x07) << 8));
+}
 
+static void set_channel_3_freq_specifier_from_registers() {
+    channel_3.freq_specifier = robingb_memory[0xff1d] | ((robingb_memory[0xff1e] & 0x07) << 8);
+    channel_3.cycles_per_wave_step = (2048 - channel_3.freq_specifier) * 2;
+}
 
+static void power_off() {
+    uint16_t address;
+    for (address = 0xff10; address < 0xff26; address++) robingb_memory[address] = 0x00;
+    
+    channel_1.length.is_on = false;
+    channel_2.length.is_on = false;
+    channel_3.length.is_on = false;
+    channel_4.length.is_on = false;
+}
 
+/* Register writes are timestamped: before an APU register changes, everything up to the
+moment of the write is synthesized with the old value. Then only the state that depends on
+the written register is recomputed. */
+void robingb_audio_respond_to_register_write(uint16_t address, uint8_t value) {
+    catch_up();
+    
+    if (address >= 0xff30) {
+        robingb_memory[address] = value;
+        update_channel_3_wave_pattern(address, address + 1);
+        return;
+    }
+    
+    if (address == 0xff14 || address == 0xff19 || address == 0xff1e || address == 0xff23) {
+        robingb_memory[address] = value & ~0x80; /* the restart flag isn't stored */
+    } else if (address != 0xff26) {
+        robingb_memory[address] = value;
+    }
+    
+    switch (address) {
+        case 0xff10: break; /* the sweep settings are read on restart and at each sweep step */
+        case 0xff11:
+            channel_1.duty_pattern = duty_patterns[value >> 6];
+            channel_1.length.length_remaining = 64 - (value & 0x3f);
+            break;
+        case 0xff12:
+            if ((value & 0xf8) == 0) channel_1.length.is_on = false; /* the DAC is off */
+            break;
+        case 0xff13:
+            set_square_channel_freq_specifier_from_registers(&channel_1, 0xff13);
+            break;
+        case 0xff14:
+            set_square_channel_freq_specifier_from_registers(&channel_1, 0xff13);
+            channel_1.length.length_is_enabled = value & 0x40;
+            if (value & 0x80) {
+                trigger_square_channel(&channel_1, 0xff12);
+                trigger_channel_1_sweep();
+            }
+            break;
+        case 0xff16:
+            channel_2.duty_pattern = duty_patterns[value >> 6];
+            channel_2.length.length_remaining = 64 - (value & 0x3f);
+            break;
+        case 0xff17:
+            if ((value & 0xf8) == 0) channel_2.length.is_on = false;
+            break;
+        case 0xff18:
+            set_square_channel_freq_specifier_from_registers(&channel_2, 0xff18);
+            break;
+        case 0xff19:
+            set_square_channel_freq_specifier_from_registers(&channel_2, 0xff18);
+            channel_2.length.length_is_enabled = value & 0x40;
+            if (value & 0x80) trigger_square_channel(&channel_2, 0xff17);
+            break;
+        case 0xff1a:
+            if ((value & 0x80) == 0) channel_3.length.is_on = false;
+            break;
+        case 0xff1b:
+            channel_3.length.length_remaining = 256 - value;
+            break;
+        case 0xff1c:
+            update_channel_3_wave_pattern(0xff30, 0xff40);
+            break;
+        case 0xff1d:
+            set_channel_3_freq_specifier_from_registers();
+            break;
+        case 0xff1e:
+            set_channel_3_freq_specifier_from_registers();
+            channel_3.length.length_is_enabled = value & 0x40;
+            if (value & 0x80) trigger_channel_3();
+            break;
+        case 0xff20:
+            channel_4.length.length_remaining = 64 - (value & 0x3f);
+            break;
+        case 0xff21:
+            if ((value & 0xf8) == 0) channel_4.length.is_on = false;
+            break;
+        case 0xff22:
+            set_channel_4_lfsr_from_register(value);
+            break;
+        case 0xff23:
+            channel_4.length.length_is_enabled = value & 0x40;
+            if (value & 0x80) trigger_channel_4();
+            break;
+        case 0xff24:
+        case 0xff25:
+            if (robingb_audio_is_enabled && stereo) {
+                /* The samples so far are mixed with the old panning. */
+                output_samples(count_finished_samples());
+                update_stereo_gains();
+            }
+            break;
+        case 0xff26:
+            /* Only the power bit is writable. The rest is the status of each channel. */
+            robingb_memory[address] = value & 0x80;
+            if ((value & 0x80) == 0) power_off();
+            break;
+        default: break;
+    }
+    
+    update_status_register();
+}
 
+uint8_t robingb_audio_respond_to_status_read() {
+    catch_up();
+    return robingb_memory[0xff26];
+}
 
+void robingb_audio_init(uint32_t sample_rate) {
+    uint32_t max_samples_per_segment, max_adjusted_sample_rate;
+    
+#ifndef ROBINGB_DISABLE_AUDIO
+    robingb_audio_is_enabled = sample_rate != 0;
+#endif
+    if (!robingb_audio_is_enabled) return;
+    
+    SAMPLE_RATE = sample_rate;
+    adjusted_sample_rate = sample_rate;
+    next_adjusted_sample_rate = sample_rate;
+    
+    build_lfsr_table(lfsr_15_bit_table, LFSR_15_BIT_PERIOD, false);
+    build_lfsr_table(lfsr_7_bit_table, LFSR_7_BIT_PERIOD, true);
+    set_channel_4_lfsr_from_register(robingb_memory[0xff22]);
+    
+    /* Up to AUDIO_BLOCK_LENGTH samples can be waiting in the delta buffers when a segment begins. */
+    max_samples_per_segment = DELTA_BUFFER_LENGTH - KERNEL_WIDTH - 1 - AUDIO_BLOCK_LENGTH;
+    max_adjusted_sample_rate = SAMPLE_RATE + SAMPLE_RATE / RATE_CONTROL_MAX_ADJUSTMENT_DIVISOR + 1;
+    max_cycles_per_segment = (max_samples_per_segment << CPU_CLOCK_FREQ_BITS) / max_adjusted_sample_rate;
+}
+
+void robingb_audio_update(uint32_t num_cycles) {
+    if (!robingb_audio_is_enabled) return;
+    
+    synthesize_until(num_cycles);
+    
+    block_position += num_cycles_synthesized * adjusted_sample_rate;
+    num_cycles_synthesized = 0;
+    
+    adjusted_sample_rate = next_adjusted_sample_rate;
+}
+
+void robingb_set_audio_rate_control(uint16_t target_sample_count) {
+    rate_control.target_sample_count = target_sample_count;
+    rate_control.filtered_sample_count = target_sample_count << RATE_CONTROL_FILTER_SHIFT;
+    next_adjusted_sample_rate = SAMPLE_RATE;
+}
+
+uint16_t robingb_get_audio_sample_count() {
+    if (!robingb_audio_is_enabled) return 0;
+    
+    return audio_ring.num_written - audio_ring.num_read;
+}
 
+static uint16_t ready_threshold = 0; /* 0 if the host doesn't want the event */
+
+void robingb_set_audio_ready_threshold(uint16_t sample_count) {
+    ready_threshold = sample_count;
+}
+
+bool robingb_audio_buffer_is_ready() {
+    return ready_threshold > 0 && robingb_get_audio_sample_count() >= ready_threshold;
+}
+
+void robingb_get_audio_stats(uint32_t *underrun_count, uint32_t *overrun_count) {
+    if (!robingb_audio_is_enabled) {
+        if (underrun_count) *underrun_count = 0;
+        if (overrun_count) *overrun_count = 0;
+        return;
+    }
+    
+    if (underrun_count) *underrun_count = audio_ring.underrun_count;
+    if (overrun_count) *overrun_count = audio_ring.overrun_count;
+}
+
+void robingb_get_audio_samples(int8_t samples_out[], uint16_t samples_count) {
+    uint16_t num_available, read_index, s;
+    
+    if (!robingb_audio_is_enabled) {
+        memset(samples_out, 0, samples_count);
+        return;
+    }
+    
+    assert(!stereo);
+    
+    num_available = audio_ring.num_written - audio_ring.num_read;
+    robingb_memory_barrier();
+    
+    read_index = audio_ring.num_read;
+    
+    for (s = 0; s < samples_count && s < num_available; s++) {
+        samples_out[s] = audio_ring.samples[(read_index++) % AUDIO_RING_LENGTH];
+    }
+    
+    if (s > 0) audio_ring.last_sample_read = samples_out[s-1];
+    
+    if (s < samples_count) {
+        /* The emulation is running behind. Repeat the last sample rather than popping. */
+        audio_ring.underrun_count++;
+        for (; s < samples_count; s++) samples_out[s] = audio_ring.last_sample_read;
+    }
+    
+    robingb_memory_barrier();
+    audio_ring.num_read = read_index;
+}
 
+bool robingb_set_stereo_audio(bool enabled) {
+    uint8_t c;
+    
+    if (!robingb_audio_is_enabled) return !enabled;
+    
+    if (enabled && !stereo) {
+        stereo = (Stereo_Output*)calloc(1, sizeof(Stereo_Output));
+        if (!stereo) return false;
+        
+        for (c = 0; c < NUM_CHANNELS; c++) channel_deltas[c] = stereo->deltas[c];
+        
+        stereo->integrators[0] = channel_1.output << KERNEL_UNITY_BITS;
+        stereo->integrators[1] = channel_2.output << KERNEL_UNITY_BITS;
+        stereo->integrators[2] = channel_3.output << KERNEL_UNITY_BITS;
+        stereo->integrators[3] = channel_4.output << KERNEL_UNITY_BITS;
+        update_stereo_gains();
+    } else if (!enabled && stereo) {
+        free(stereo);
+        stereo = NULL;
+        
+        for (c = 0; c < NUM_CHANNELS; c++) channel_deltas[c] = mono_deltas;
+        
+        mono_integrator = (channel_1.output + channel_2.output + channel_3.output + channel_4.output) << KERNEL_UNITY_BITS;
+    } else return true;
+    
+    /* Samples in the old format are discarded. */
+    memset(mono_deltas, 0, sizeof(mono_deltas));
+    audio_ring.num_read = audio_ring.num_written;
+    
+    return true;
+}
 
+void robingb_get_stereo_audio_samples(int16_t samples_out[], uint16_t frames_count) {
+    uint16_t num_available, read_index, f;
+    
+    if (!robingb_audio_is_enabled) {
+        memset(samples_out, 0, frames_count * 2 * sizeof(int16_t));
+        return;
+    }
+    
+    assert(stereo);
+    
+    num_available = audio_ring.num_written - audio_ring.num_read;
+    robingb_memory_barrier();
+    
+    read_index = audio_ring.num_read;
+    
+    for (f = 0; f < frames_count && f < num_available; f++) {
+        uint16_t ring_index = (read_index++) % AUDIO_RING_LENGTH;
+        samples_out[f*2] = stereo->ring_samples[ring_index*2];
+        samples_out[f*2 + 1] = stereo->ring_samples[ring_index*2 + 1];
+    }
+    
+    if (f > 0) {
+        stereo->last_frame_read[0] = samples_out[(f-1)*2];
+        stereo->last_frame_read[1] = samples_out[(f-1)*2 + 1];
+    }
+    
+    if (f < frames_count) {
+        /* The emulation is running behind. Repeat the last frame rather than popping. */
+        audio_ring.underrun_count++;
+        for (; f < frames_count; f++) {
+            samples_out[f*2] = stereo->last_frame_read[0];
+            samples_out[f*2 + 1] = stereo->last_frame_read[1];
+        }
+    }
+    
+    robingb_memory_barrier();
+    audio_ring.num_read = read_index;
+}
@@ -42,7 +42,7 @@ void init_registers() {
     registers.hl = 0x014d;
     registers.sp = 0xfffe;
     registers.pc = 0x0100;
-    registers.ime = true;
+    robingb_set_interrupt_master_enable(true);
 }
 
 void robingb_init(
@@ -91,34 +91,215 @@ void robingb_init(
         sum += 25;
         uint8_t *bytes = (uint8_t*)&sum;
         assert(bytes[0] == 0);
+        (void)bytes; /* only used by the assert */
     }
     
     init_registers();
+    robingb_reset_fusion_stats();
+    robingb_reset_profile();
     robingb_timer_init();
+    robingb_lcd_init();
+    robingb_render_init();
 }
 
 uint8_t *lcd_ly = &robingb_memory[LCD_LY_ADDRESS];
 
-bool robingb_update_screen_line(uint8_t screen_out[], uint8_t *updated_screen_line) {
-    uint8_t previous_lcd_ly = *lcd_ly;
+uint32_t robingb_cycle_count = 0;
+
+/* Audio is updated once per line, with the number of cycles since the previous update.
+The audio also reads this to timestamp writes to its registers. */
+uint32_t robingb_num_cycles_since_audio_update = 0;
+
+/*
+Busy-wait loops: Games often spin on a short loop like "LDH A,(44h); CP 90h; JR NZ" until
+LY, STAT or IF changes. Those registers only change when the LCD or the timer handles an
+event (or when the host presses a button, see robingb_forget_idle_loop()), so once a loop has
+done a full pass without an event happening, every further pass does exactly the same thing
+until the next event. Those passes are skipped by advancing the clock by whole passes,
+stopping short of the next event, the audio's next frame sequencer step, and the end of the
+caller's cycle budget.
+*/
+
+#define MAX_IDLE_LOOP_LENGTH 16 /* in bytes, including the jump back */
+
+static struct {
+    uint16_t dispatch_address; /* 0 when no loop is being watched */
+    uint16_t target_address;
+    uint16_t bc, de, hl; /* that is_idle was worked out with, as loops can read through them */
+    bool is_idle;
+    uint32_t cycle; /* when the jump was last taken */
+    uint32_t lcd_next_event_cycle;
+    uint32_t timer_overflow_cycle;
+} idle_loop;
+
+/* Whether the value at the address can only change when the CPU writes to it or when the LCD
+or timer handle an event. */
+static bool address_is_stable_between_events(uint16_t address) {
+    if (address >= 0xa000 && address < 0xc000) return false; /* the cart's clock could be here */
+    if (address < 0xff00 || address >= 0xff80) return true;
     
-    robingb_screen = screen_out;
-    assert(robingb_screen);
+    return address == INTERRUPT_FLAG_ADDRESS
+        || address == LCD_STATUS_ADDRESS
+        || address == LCD_LY_ADDRESS;
+}
+
+/* Returns the length of the instruction if it only reads stable addresses and only changes
+A and F. Otherwise returns 0. */
+static uint8_t get_idle_instruction_length(uint16_t address) {
+    uint8_t opcode = robingb_memory_read(address);
+    
+    switch (opcode) {
+        case 0xf0: /* LDH A,(x) */
+            return address_is_stable_between_events(0xff00 + robingb_memory_read(address+1)) ? 2 : 0;
+        case 0xfa: /* LD A,(xx) */
+            return address_is_stable_between_events(robingb_memory_read_u16(address+1)) ? 3 : 0;
+        case 0x0a: /* LD A,(BC) */
+            return address_is_stable_between_events(registers.bc) ? 1 : 0;
+        case 0x1a: /* LD A,(DE) */
+            return address_is_stable_between_events(registers.de) ? 1 : 0;
+        case 0x7e: /* LD A,(HL) */
+            return address_is_stable_between_events(registers.hl) ? 1 : 0;
+        case 0xa7: /* AND A */
+        case 0xb7: /* OR A */
+            return 1;
+        case 0xe6: /* AND x */
+        case 0xf6: /* OR x */
+        case 0xfe: /* CP x */
+            return 2;
+        case 0xcb: {
+            uint8_t cb_opcode = robingb_memory_read(address+1);
+            if ((cb_opcode & 0xc7) == 0x47) return 2; /* BIT b,A */
+            if ((cb_opcode & 0xc7) == 0x46) return address_is_stable_between_events(registers.hl) ? 2 : 0; /* BIT b,(HL) */
+            return 0;
+        }
+        default: return 0;
+    }
+}
+
+static bool is_jump_opcode(uint8_t opcode) {
+    switch (opcode) {
+        case 0x18: case 0x20: case 0x28: case 0x30: case 0x38: return true; /* JR */
+        case 0xc3: case 0xc2: case 0xca: case 0xd2: case 0xda: return true; /* JP */
+        default: return false;
+    }
+}
+
+/* The jump back may have been fused onto the instruction before it, so the dispatch that
+jumped can start at or before the jump itself. */
+static bool loop_is_idle(uint16_t target_address, uint16_t dispatch_address) {
+    uint16_t address = target_address;
+    
+    while (address - target_address < MAX_IDLE_LOOP_LENGTH) {
+        uint8_t length;
+        if (is_jump_opcode(robingb_memory_read(address))) return address >= dispatch_address;
+        
+        length = get_idle_instruction_length(address);
+        if (length == 0) return false;
+        address += length;
+    }
     
-    uint32_t num_cycles_this_h_blank = 0;
+    return false;
+}
+
+void robingb_forget_idle_loop() {
+    idle_loop.dispatch_address = 0;
+}
+
+/* Called when a dispatch jumps a short distance backwards. Returns the number of cycles
+skipped, which is at most max_cycles_skipped. */
+static uint32_t skip_idle_loop(uint16_t dispatch_address, uint32_t max_cycles_skipped) {
+    uint16_t target_address = registers.pc;
     
-    while (*lcd_ly == previous_lcd_ly) {
-        uint8_t num_cycles_this_opcode;
-        robingb_execute_next_opcode(&num_cycles_this_opcode);
+    if (dispatch_address != idle_loop.dispatch_address || target_address != idle_loop.target_address
+        || registers.bc != idle_loop.bc || registers.de != idle_loop.de || registers.hl != idle_loop.hl) {
+        idle_loop.dispatch_address = dispatch_address;
+        idle_loop.target_address = target_address;
+        idle_loop.bc = registers.bc;
+        idle_loop.de = registers.de;
+        idle_loop.hl = registers.hl;
+        idle_loop.is_idle = loop_is_idle(target_address, dispatch_address);
+    } else if (idle_loop.is_idle
+        && idle_loop.lcd_next_event_cycle == robingb_lcd_next_event_cycle
+        && idle_loop.timer_overflow_cycle == robingb_timer_overflow_cycle) {
+        
+        /* A full pass happened without any events, so skip as many passes as will fit
+        before the next one. */
+        uint32_t cycles_per_pass = robingb_cycle_count - idle_loop.cycle;
+        uint32_t cycles_until_lcd_event = robingb_lcd_next_event_cycle - robingb_cycle_count;
+        uint32_t cycles_until_timer_overflow = robingb_timer_overflow_cycle - robingb_cycle_count;
+        uint32_t cycles_until_audio_event = robingb_audio_cycles_until_next_event();
+        uint32_t cycles_until_event = cycles_until_lcd_event < cycles_until_timer_overflow
+            ? cycles_until_lcd_event : cycles_until_timer_overflow;
+        uint32_t num_cycles_skipped = 0;
         
-        robingb_handle_interrupts();
-        robingb_lcd_update(num_cycles_this_opcode);
-        robingb_timer_update(num_cycles_this_opcode);
+        if (cycles_until_audio_event < cycles_until_event) cycles_until_event = cycles_until_audio_event;
+        if (cycles_until_event > 0) num_cycles_skipped = ((cycles_until_event - 1) / cycles_per_pass) * cycles_per_pass;
+        if (num_cycles_skipped > max_cycles_skipped) num_cycles_skipped = (max_cycles_skipped / cycles_per_pass) * cycles_per_pass;
         
-        num_cycles_this_h_blank += num_cycles_this_opcode;
+        robingb_cycle_count += num_cycles_skipped;
+        robingb_num_cycles_since_audio_update += num_cycles_skipped;
+#ifdef ROBINGB_ENABLE_PROFILER
+        robingb_exclude_from_profile(num_cycles_skipped);
+#endif
+        idle_loop.cycle = robingb_cycle_count;
+        return num_cycles_skipped;
     }
     
-    robingb_audio_update(num_cycles_this_h_blank);
+    idle_loop.cycle = robingb_cycle_count;
+    idle_loop.lcd_next_event_cycle = robingb_lcd_next_event_cycle;
+    idle_loop.timer_overflow_cycle = robingb_timer_overflow_cycle;
+    return 0;
+}
+
+/* Runs one instruction (and any interrupt dispatch), and returns the number of cycles it
+took. Idle loops are only skipped as far as cycle_budget allows. */
+static uint32_t run_next_instruction(uint32_t cycle_budget) {
+    uint16_t instruction_address = registers.pc;
+    uint16_t next_address;
+    uint8_t num_cycles_this_opcode;
+    robingb_execute_next_opcode(&num_cycles_this_opcode);
+    
+    next_address = registers.pc;
+    if (robingb_interrupt_is_pending) robingb_handle_interrupts();
+    if (registers.pc != next_address) idle_loop.dispatch_address = 0; /* an interrupt was serviced */
+    
+    robingb_cycle_count += num_cycles_this_opcode;
+#ifdef ROBINGB_ENABLE_PROFILER
+    /* While halted, the PC is left just after the HALT, which is charged with the time. */
+    if (robingb_cycle_has_passed(robingb_next_profile_sample_cycle)) robingb_take_profile_sample(halted ? next_address - 1 : instruction_address);
+#endif
+    while (robingb_cycle_has_passed(robingb_lcd_next_event_cycle)) robingb_lcd_handle_event();
+    while (robingb_cycle_has_passed(robingb_timer_overflow_cycle)) robingb_timer_handle_overflow();
+    
+    robingb_num_cycles_since_audio_update += num_cycles_this_opcode;
+    
+    if (next_address < instruction_address
+        && instruction_address - next_address <= MAX_IDLE_LOOP_LENGTH
+        && registers.pc == next_address) {
+        
+        uint32_t max_cycles_skipped = cycle_budget > num_cycles_this_opcode ? cycle_budget - num_cycles_this_opcode : 0;
+        return num_cycles_this_opcode + skip_idle_loop(instruction_address, max_cycles_skipped);
+    }
+    
+    return num_cycles_this_opcode;
+}
+
+static void update_audio() {
+    if (!robingb_audio_is_enabled) return; /* the audio registers catch up when they're accessed */
+    
+    robingb_audio_update(robingb_num_cycles_since_audio_update);
+    robingb_num_cycles_since_audio_update = 0;
+}
+
+bool robingb_update_screen_line(uint8_t screen_out[], uint8_t *updated_screen_line) {
+    uint8_t previous_lcd_ly = *lcd_ly;
+    
+    robingb_screen = screen_out;
+    assert(robingb_screen || robingb_line_sink_is_set());
+    
+    while (*lcd_ly == previous_lcd_ly) run_next_instruction(0xffffffff);
+    
+    update_audio();
     
     if (previous_lcd_ly < 144) {
         *updated_screen_line = previous_lcd_ly;
@@ -126,6 +307,53 @@ bool robingb_update_screen_line(uint8_t screen_out[], uint8_t *updated_screen_li
     } else return false;
 }
 
+uint32_t robingb_run_cycles(uint8_t screen_out[], uint32_t cycle_budget, uint8_t *events_out) {
+    uint32_t num_cycles_run = 0;
+    uint8_t events = 0;
+    
+    robingb_screen = screen_out;
+    assert(robingb_screen || robingb_line_sink_is_set());
+    
+    while (num_cycles_run < cycle_budget) {
+        uint8_t previous_lcd_ly = *lcd_ly;
+        
+        num_cycles_run += run_next_instruction(cycle_budget - num_cycles_run);
+        
+        if (*lcd_ly != previous_lcd_ly) {
+            update_audio();
+            if (robingb_audio_buffer_is_ready()) events |= ROBINGB_EVENT_AUDIO_BUFFER_READY;
+            
+            if (previous_lcd_ly < 144) events |= ROBINGB_EVENT_LINE_COMPLETED;
+            if (*lcd_ly == 144) events |= ROBINGB_EVENT_VBLANK;
+        }
+    }
+    
+    if (events_out) *events_out = events;
+    return num_cycles_run;
+}
+
+/* ROBINGB_CYCLES_PER_SECOND/1000000 reduces to 65536/15625. The conversions are split up so
+that they don't overflow 32 bits. */
+#define CYCLES_PER_MICROSECOND_NUMERATOR 65536
+#define CYCLES_PER_MICROSECOND_DENOMINATOR 15625
+
+uint32_t robingb_run_microseconds(uint8_t screen_out[], uint32_t microseconds, uint8_t *events_out) {
+    /* The fraction of a cycle left over from the previous call, in 1/15625ths */
+    static uint32_t cycle_remainder = 0;
+    
+    uint32_t scaled_remainder = (microseconds % CYCLES_PER_MICROSECOND_DENOMINATOR) * CYCLES_PER_MICROSECOND_NUMERATOR + cycle_remainder;
+    uint32_t cycle_budget = (microseconds / CYCLES_PER_MICROSECOND_DENOMINATOR) * CYCLES_PER_MICROSECOND_NUMERATOR
+        + scaled_remainder / CYCLES_PER_MICROSECOND_DENOMINATOR;
+    uint32_t num_cycles_run;
+    
+    cycle_remainder = scaled_remainder % CYCLES_PER_MICROSECOND_DENOMINATOR;
+    
+    num_cycles_run = robingb_run_cycles(screen_out, cycle_budget, events_out);
+    
+    return (num_cycles_run / CYCLES_PER_MICROSECOND_NUMERATOR) * CYCLES_PER_MICROSECOND_DENOMINATOR
+        + (num_cycles_run % CYCLES_PER_MICROSECOND_NUMERATOR) * CYCLES_PER_MICROSECOND_DENOMINATOR / CYCLES_PER_MICROSECOND_NUMERATOR;
+}
+
 void robingb_update_screen(uint8_t screen_out[]) {
     uint8_t updated_screen_line;
     
@@ -3,6 +3,24 @@
 
 /* Declarations for identifiers used across compilation units. */
 
+#include "robingb_config.h"
+
+/* This must come before any .c file includes assert.h, so internal.h is always included first. */
+#if defined(ROBINGB_DISABLE_ASSERTS) && !defined(NDEBUG)
+#define NDEBUG
+#endif
+
+#include <stdio.h>
+
+/* All of RobinGB's console output goes through robingb_log(), which takes printf()'s
+arguments. Without variadic macros it can only stand for a function, so disabling it puts
+the call in a branch that is never taken, and the compiler removes it. */
+#ifdef ROBINGB_DISABLE_LOGGING
+#define robingb_log 1 ? (void)0 : (void)printf
+#else
+#define robingb_log printf
+#endif
+
 #include "RobinGB.h"
 
 #define GAME_BOY_MEMORY_ADDRESS_SPACE_SIZE (1024*64)
@@ -11,6 +29,25 @@
 
 #define robingb_bit(n) (0x01 << n)
 
+/* A full memory barrier (for the compiler and the CPU), for data shared between the
+emulation thread and a host thread. */
+#if defined(ROBINGB_SINGLE_THREADED)
+#define robingb_memory_barrier() ((void)0)
+#elif defined(__GNUC__)
+#define robingb_memory_barrier() __sync_synchronize()
+#elif defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L && !defined(__STDC_NO_ATOMICS__)
+#include <stdatomic.h>
+#define robingb_memory_barrier() atomic_thread_fence(memory_order_seq_cst)
+#elif defined(_MSC_VER)
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#define robingb_memory_barrier() MemoryBarrier()
+#else
+#error "RobinGB doesn't know a memory barrier for this compiler. Add one here, or define ROBINGB_SINGLE_THREADED in robingb_config.h."
+#endif
+
 #define FLAG_Z (0x80) /* Zero Flag */
 #define FLAG_N (0x40) /* Add/Sub-Flag (BCD) */
 #define FLAG_H (0x20) /* Half Carry Flag (BCD) */
@@ -75,13 +112,62 @@ extern char *robingb_cart_path;
 extern char *robingb_save_path;
 extern Registers registers;
 extern bool halted;
+extern uint32_t robingb_cycle_count; /* wraps around, so compare with robingb_cycle_has_passed() */
+extern uint32_t robingb_timer_overflow_cycle;
+extern uint32_t robingb_lcd_next_event_cycle;
+extern uint32_t robingb_num_cycles_since_audio_update;
+
+/* True if robingb_cycle_count has reached cycle, allowing for wraparound. */
+#define robingb_cycle_has_passed(cycle) ((uint32_t)(robingb_cycle_count - (cycle)) < 0x80000000u)
+
+/* The switches in robingb_config.h become constants where possible, so that the code they
+disable is still compiled (and checked) but then removed as dead code. */
+#ifdef ROBINGB_DISABLE_AUDIO
+#define robingb_audio_is_enabled false
+#else
+extern bool robingb_audio_is_enabled;
+#endif
 
+#ifdef ROBINGB_DISABLE_OBJECTS
+#define robingb_objects_are_supported false
+#else
+#define robingb_objects_are_supported true
+#endif
+
+#ifdef ROBINGB_DISABLE_MBC1
+#define robingb_mbc1_is_supported false
+#else
+#define robingb_mbc1_is_supported true
+#endif
+
+#ifdef ROBINGB_DISABLE_ECHO_RAM
+#define robingb_echo_ram_is_supported false
+#else
+#define robingb_echo_ram_is_supported true
+#endif
+
+#ifdef ROBINGB_ENABLE_INSTRUMENTATION
+#define robingb_instrumentation_is_enabled true
+#else
+#define robingb_instrumentation_is_enabled false
+#endif
+
+extern bool robingb_interrupt_is_pending; /* IME is set and IF & IE is non-zero */
+void robingb_set_interrupt_master_enable(bool enabled); /* keeps robingb_interrupt_is_pending up to date */
 void robingb_request_interrupt(uint8_t interrupts_to_request);
 void robingb_handle_interrupts();
+void robingb_interrupts_respond_to_register_write(uint16_t address, uint8_t value);
 void robingb_stack_push(uint16_t value);
 uint16_t robingb_stack_pop();
 void robingb_execute_next_opcode(uint8_t *num_cycles_out);
-void robingb_execute_cb_opcode();
+void robingb_execute_cb_opcode(uint8_t opcode);
+void robingb_invalidate_fetch_region();
+void robingb_reset_fusion_stats();
+#ifdef ROBINGB_ENABLE_PROFILER
+extern uint32_t robingb_next_profile_sample_cycle;
+void robingb_take_profile_sample(uint16_t address);
+void robingb_exclude_from_profile(uint32_t num_cycles); /* for cycles that weren't executed */
+#endif
 void robingb_finish_instruction(int16_t pc_increment, uint8_t num_cycles_param);
 
 extern uint8_t robingb_memory[];
@@ -95,14 +181,28 @@ void robingb_romb_init_first_banks();
 void robingb_romb_init_additional_banks();
 void robingb_romb_perform_bank_control(int address, uint8_t value, Mbc_Type mbc_type);
 uint8_t robingb_romb_read_switchable_bank(uint16_t address);
+uint8_t *robingb_romb_get_switchable_bank();
+int16_t robingb_romb_get_switchable_bank_number();
 
-void robingb_lcd_update(int num_cycles_passed);
+void robingb_lcd_init();
+void robingb_lcd_handle_event();
+void robingb_lcd_respond_to_register_write(uint16_t address, uint8_t value);
 uint8_t robingb_respond_to_joypad_register(uint8_t new_value);
 void robingb_timer_init();
-uint8_t robingb_respond_to_timer_div_register();
-void robingb_timer_update(uint8_t num_cycles_delta);
+uint8_t robingb_timer_read_register(uint16_t address);
+void robingb_timer_respond_to_register_write(uint16_t address, uint8_t value);
+void robingb_timer_handle_overflow();
 void robingb_audio_init(uint32_t sample_rate);
 void robingb_audio_update(uint32_t num_cycles);
+void robingb_audio_respond_to_register_write(uint16_t address, uint8_t value);
+uint8_t robingb_audio_respond_to_status_read();
+bool robingb_audio_buffer_is_ready();
+uint32_t robingb_audio_cycles_until_next_event(); /* the frame sequencer's next step */
+void robingb_forget_idle_loop(); /* call when anything the host does could end an idle loop */
+void robingb_render_init();
 void robingb_render_screen_line();
+void robingb_invalidate_object_index();
+bool robingb_line_sink_is_set();
+void robingb_respond_to_vram_write(uint16_t address);
 
 #endif
@@ -4,6 +4,24 @@
 static uint8_t *requested_interrupts = &robingb_memory[INTERRUPT_FLAG_ADDRESS];
 static uint8_t *enabled_interrupts = &robingb_memory[INTERRUPT_ENABLE_ADDRESS];
 
+/* Kept up to date whenever IME, IF or IE changes, so the core only has to test this after
+each instruction. HALT only halts while IME is set, so this also covers waking from HALT. */
+bool robingb_interrupt_is_pending = false;
+
+static void update_pending_flag() {
+    robingb_interrupt_is_pending = registers.ime && ((*requested_interrupts) & (*enabled_interrupts)) != 0;
+}
+
+void robingb_set_interrupt_master_enable(bool enabled) {
+    registers.ime = enabled;
+    update_pending_flag();
+}
+
+void robingb_interrupts_respond_to_register_write(uint16_t address, uint8_t value) {
+    robingb_memory[address] = value;
+    update_pending_flag();
+}
+
 void robingb_handle_interrupts() {
     uint8_t interrupts_to_handle = (*requested_interrupts) & (*enabled_interrupts);
     
@@ -31,6 +49,8 @@ void robingb_handle_interrupts() {
                 *requested_interrupts &= ~INTERRUPT_FLAG_JOYPAD;
                 registers.pc = 0x0060;
             } else assert(false); /* unexpected interrupts_to_handle value. */
+            
+            update_pending_flag();
         }
     }
 }
@@ -38,6 +58,7 @@ void robingb_handle_interrupts() {
 void robingb_request_interrupt(uint8_t interrupt_to_request) {
     *requested_interrupts |= interrupt_to_request; /* combine with the existing request flags */
     *requested_interrupts |= 0xe0; /* top 3 bits are always 1. */
+    update_pending_flag();
 }
 
 
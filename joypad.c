@@ -24,8 +24,10 @@ void robingb_press_button(RobinGB_Button button) {
         case ROBINGB_B: action_buttons &= ~LEFT_OR_B; break;
         case ROBINGB_START: action_buttons &= ~DOWN_OR_START; break;
         case ROBINGB_SELECT: action_buttons &= ~UP_OR_SELECT; break;
-        default: printf("Invalid joypad button\n"); break;
+        default: robingb_log("Invalid joypad button\n"); break;
     }
+    
+    robingb_forget_idle_loop();
 }
 
 void robingb_release_button(RobinGB_Button button) {
@@ -38,8 +40,10 @@ void robingb_release_button(RobinGB_Button button) {
         case ROBINGB_B: action_buttons |= LEFT_OR_B; break;
         case ROBINGB_START: action_buttons |= DOWN_OR_START; break;
         case ROBINGB_SELECT: action_buttons |= UP_OR_SELECT; break;
-        default: printf("Invalid joypad button\n"); break;
+        default: robingb_log("Invalid joypad button\n"); break;
     }
+    
+    robingb_forget_idle_loop();
 }
 
 uint8_t robingb_respond_to_joypad_register(uint8_t register_value) {
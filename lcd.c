@@ -1,5 +1,6 @@
 #include "internal.h"
 #include <assert.h>
+#include <stddef.h>
 
 /* TODO: "Each bit is set to 1 automatically when an internal signal from that subsystem goes from '0' to '1', it doesn't matter if the corresponding bit in IE is set. This is specially important in the case of LCD STAT interrupt, as it will be explained in the video controller chapter." */
 
@@ -37,31 +38,114 @@ static uint8_t *status = &robingb_memory[LCD_STATUS_ADDRESS];
 static uint8_t *ly = &robingb_memory[LCD_LY_ADDRESS];
 static uint8_t *lyc = &robingb_memory[LCD_LYC_ADDRESS];
 
-void robingb_lcd_update(int num_cycles_delta) {
+uint8_t robingb_frameskip = 0;
+
+static struct {
+    uint32_t (*get_microseconds)();
+    uint32_t microseconds_per_frame;
+    uint8_t max_frameskip;
+    uint32_t previous_vblank_time;
+    int32_t lag; /* in microseconds. Positive means the host is running behind. */
+} auto_frameskip;
+
+static void (*vblank_callback)() = NULL;
+static void (*line_callback)(uint8_t screen_line) = NULL;
+static void (*lyc_callback)(uint8_t ly) = NULL;
+
+void robingb_set_vblank_callback(void (*callback)()) {
+    vblank_callback = callback;
+}
+
+void robingb_set_line_callback(void (*callback)(uint8_t screen_line)) {
+    line_callback = callback;
+}
+
+void robingb_set_lyc_callback(void (*callback)(uint8_t ly)) {
+    lyc_callback = callback;
+}
+
+static uint8_t consecutive_skipped_frames = 0;
+static bool current_frame_is_skipped = false;
+
+void robingb_set_auto_frameskip(uint32_t (*get_microseconds)(), uint32_t microseconds_per_frame, uint8_t max_frameskip) {
+    auto_frameskip.get_microseconds = get_microseconds;
+    auto_frameskip.microseconds_per_frame = microseconds_per_frame;
+    auto_frameskip.max_frameskip = max_frameskip;
+    auto_frameskip.lag = 0;
+    if (get_microseconds) auto_frameskip.previous_vblank_time = get_microseconds();
+}
+
+/* Called on V-blank entry to decide whether the coming frame gets rendered. */
+static bool should_skip_next_frame() {
+    uint8_t max_frameskip = robingb_frameskip;
+    bool is_behind = true;
+    
+    if (auto_frameskip.get_microseconds) {
+        uint32_t now = auto_frameskip.get_microseconds();
+        int32_t budget = auto_frameskip.microseconds_per_frame;
+        
+        /* unsigned subtraction, so the host's clock is allowed to wrap around */
+        auto_frameskip.lag += (int32_t)(now - auto_frameskip.previous_vblank_time) - budget;
+        auto_frameskip.previous_vblank_time = now;
+        
+        /* Limit the lag in both directions, so that a long stall or a long idle
+        period doesn't affect the frameskip for the following few seconds. */
+        if (auto_frameskip.lag < -budget) auto_frameskip.lag = -budget;
+        else if (auto_frameskip.lag > budget * 4) auto_frameskip.lag = budget * 4;
+        
+        max_frameskip = auto_frameskip.max_frameskip;
+        is_behind = auto_frameskip.lag > 0;
+    }
+    
+    return is_behind && consecutive_skipped_frames < max_frameskip;
+}
+
+/* The LCD doesn't run every instruction. It calculates the cycle of its next transition
+(the next mode change or LY increment) and the core calls robingb_lcd_handle_event() once
+that cycle has passed. */
+uint32_t robingb_lcd_next_event_cycle;
+
+static uint32_t line_start_cycle; /* when the current value of LY began */
+static uint32_t cycles_into_line_when_switched_off = 0;
+
+/* Updates the LY=LYC flag. The interrupt and callback only happen when it becomes set. */
+static void update_coincidence() {
+    if (*ly == *lyc) {
+        if (((*status) & 0x04) == 0) {
+            if (lyc_callback) lyc_callback(*ly);
+            if ((*status) & 0x40) robingb_request_interrupt(INTERRUPT_FLAG_LCD_STAT);
+        }
+        
+        *status |= 0x04;
+    } else {
+        *status &= ~0x04;
+    }
+}
+
+void robingb_lcd_init() {
+    line_start_cycle = robingb_cycle_count;
+    robingb_lcd_next_event_cycle = robingb_cycle_count;
+}
+
+void robingb_lcd_handle_event() {
+    uint32_t elapsed_cycles;
+    
     if (((*control) & LCDC_ENABLED_BIT) == 0) {
-        /* Bit 7 of the LCD control register is 0, so the LCD is switched off. */
-        /* LY, the mode, and the LYC=LY flag should all be 0. */
-        *ly = 0x00;
-        *status &= 0xf8;
-        return; 
+        /* This is only reached if the LCD stays switched off for a very long time. */
+        robingb_lcd_next_event_cycle = robingb_cycle_count + 0x7fffffff;
+        return;
     }
     
-    static int32_t elapsed_cycles = 0;
-    elapsed_cycles += num_cycles_delta;
+    elapsed_cycles = robingb_cycle_count - line_start_cycle;
     
     /* set LY */
     if (elapsed_cycles >= NUM_CYCLES_PER_LY_INCREMENT) {
+        line_start_cycle += NUM_CYCLES_PER_LY_INCREMENT;
         elapsed_cycles -= NUM_CYCLES_PER_LY_INCREMENT;
         
         if (++(*ly) >= LY_MAXIMUM_VALUE) *ly = 0;
-    }
-    
-    /* handle LYC */
-    if (*ly == *lyc) {
-        *status |= 0x04;
-        if ((*status) & 0x40) robingb_request_interrupt(INTERRUPT_FLAG_LCD_STAT);
-    } else {
-        *status &= ~0x04;
+        
+        update_coincidence();
     }
     
     /* set mode */
@@ -80,34 +164,78 @@ void robingb_lcd_update(int num_cycles_delta) {
         if (elapsed_cycles >= MODE_2_CYCLE_DURATION + MODE_3_CYCLE_DURATION) {
             *status |= 0x00; /* H-blank */
             
-            if (prev_mode != 0x00 && ((*status) & 0x08)) {
-                robingb_request_interrupt(INTERRUPT_FLAG_LCD_STAT);
+            if (prev_mode != 0x00) {
+                if ((*status) & 0x08) robingb_request_interrupt(INTERRUPT_FLAG_LCD_STAT);
+                if (line_callback) line_callback(*ly);
             }
+            
+            robingb_lcd_next_event_cycle = line_start_cycle + NUM_CYCLES_PER_LY_INCREMENT;
         } else if (elapsed_cycles >= MODE_2_CYCLE_DURATION) {
             *status |= 0x03; /* The LCD is reading from both OAM and VRAM */
             
-            if (prev_mode != 0x03) robingb_render_screen_line();
+            if (prev_mode != 0x03 && !current_frame_is_skipped) robingb_render_screen_line();
+            
+            robingb_lcd_next_event_cycle = line_start_cycle + MODE_2_CYCLE_DURATION + MODE_3_CYCLE_DURATION;
         } else {
             *status |= 0x02; /* The LCD is reading from OAM */
             
             if (prev_mode != 0x02 && ((*status) & 0x20)) {
                 robingb_request_interrupt(INTERRUPT_FLAG_LCD_STAT);
             }
+            
+            robingb_lcd_next_event_cycle = line_start_cycle + MODE_2_CYCLE_DURATION;
         }
         
     } else {
         *status |= 0x01; /* V-blank */
         
         if (prev_mode != 0x01) {
+            current_frame_is_skipped = should_skip_next_frame();
+            if (current_frame_is_skipped) consecutive_skipped_frames++;
+            else consecutive_skipped_frames = 0;
+            
             robingb_request_interrupt(INTERRUPT_FLAG_VBLANK);
             if ((*status) & 0x10) robingb_request_interrupt(INTERRUPT_FLAG_LCD_STAT);
+            
+            if (vblank_callback) vblank_callback();
         }
+        
+        robingb_lcd_next_event_cycle = line_start_cycle + NUM_CYCLES_PER_LY_INCREMENT;
     }
 }
 
-
-
-
-
-
-
+void robingb_lcd_respond_to_register_write(uint16_t address, uint8_t value) {
+    bool was_enabled = (*control) & LCDC_ENABLED_BIT;
+    
+    if (address == LCD_STATUS_ADDRESS) {
+        /* The mode and the LY=LYC flag are read-only. */
+        uint8_t newly_enabled_interrupts = value & ~(*status);
+        *status = (value & 0xf8) | ((*status) & 0x07);
+        
+        if ((newly_enabled_interrupts & 0x40) && ((*status) & 0x04)) {
+            robingb_request_interrupt(INTERRUPT_FLAG_LCD_STAT);
+        }
+        
+        return;
+    }
+    
+    robingb_memory[address] = value;
+    
+    if (address == LCD_LYC_ADDRESS) {
+        if (was_enabled) update_coincidence();
+    } else if (address == LCD_CONTROL_ADDRESS) {
+        bool is_enabled = value & LCDC_ENABLED_BIT;
+        
+        if (was_enabled && !is_enabled) {
+            /* The LCD is switched off, so LY, the mode, and the LYC=LY flag should all be 0.
+            The position within the line is kept for when it's switched back on. */
+            cycles_into_line_when_switched_off = robingb_cycle_count - line_start_cycle;
+            *ly = 0x00;
+            *status &= 0xf8;
+            robingb_lcd_next_event_cycle = robingb_cycle_count + 0x7fffffff;
+        } else if (!was_enabled && is_enabled) {
+            line_start_cycle = robingb_cycle_count - cycles_into_line_when_switched_off;
+            robingb_lcd_next_event_cycle = robingb_cycle_count; /* at the end of this instruction */
+        }
+    }
+}
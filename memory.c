@@ -55,7 +55,7 @@ static struct {
 } cart_state;
 
 static void ramb_perform_bank_control(int address, uint8_t value) {
-    printf("perform_ram_bank_control: %x %x\n", address, value);
+    robingb_log("perform_ram_bank_control: %x %x\n", address, value);
     if (cart_state.mbc_type == MBC_1) {
         assert(address >= 0x4000 && address < 0x6000);
         assert(value == 0); /* RAM bank switching not supported yet */
@@ -65,15 +65,15 @@ static void ramb_perform_bank_control(int address, uint8_t value) {
 }
 
 static void read_save_file() {
-    printf("Checking for saved RAM\n");
+    robingb_log("Checking for saved RAM\n");
     assert(cart_state.ram_bank_count == 1); /* Only one bank is currently supported */
     
     uint8_t *ram_address = &robingb_memory[0xa000];
     int ram_size = 0xc000 - 0xa000;
     bool success = robingb_read_file(robingb_save_path, 0, ram_size, ram_address);
     
-    if (success) printf("Loaded saved RAM\n");
-    else printf("No saved RAM found\n");
+    if (success) robingb_log("Loaded saved RAM\n");
+    else robingb_log("No saved RAM found\n");
 }
 
 void robingb_update_save_file() {
@@ -85,11 +85,14 @@ void robingb_update_save_file() {
     int ram_size = 0xc000 - 0xa000;
     bool success = robingb_write_file(robingb_save_path, false, ram_size, ram_address);
     assert(success);
+    (void)success; /* only used by the assert */
     cart_state.save_file_is_outdated = false;
 }
 
 static void perform_cart_control(int address, uint8_t value) {
-    /* printf("perform_cart_control: %x %x\n", address, value); */
+    /* robingb_log("perform_cart_control: %x %x\n", address, value); */
+    
+    if (!robingb_mbc1_is_supported) return; /* only ROM-only carts are supported, which ignore this */
     
     if (address >= 0x0000 && address < 0x2000) {
         /* MBC1: enable/disable external RAM (at 0xa000 to 0xbfff) */
@@ -128,10 +131,10 @@ static void perform_cart_control(int address, uint8_t value) {
         
         if (value & 0x01) {
             cart_state.banking_mode = BM_RAM;
-            printf("Switched to RAM banking mode\n");
+            robingb_log("Switched to RAM banking mode\n");
         } else {
             cart_state.banking_mode = BM_ROM;
-            printf("Switched to RAM banking mode\n");
+            robingb_log("Switched to RAM banking mode\n");
         }
         
     } else assert(false);
@@ -143,7 +146,7 @@ static Mbc_Type calculate_mbc_type(Cart_Type cart_type) {
         case CART_TYPE_RAM:
         case CART_TYPE_RAM_BATTERY:
             /* TODO: Not sure if this is a complete list of non-MBC cart types. */
-            printf("Cart has no MBC\n");
+            robingb_log("Cart has no MBC\n");
             assert(robingb_memory_read(0x0148) == 0x00);
             return MBC_NONE;
         break;
@@ -151,13 +154,13 @@ static Mbc_Type calculate_mbc_type(Cart_Type cart_type) {
         case CART_TYPE_MBC1:
         case CART_TYPE_MBC1_RAM:
         case CART_TYPE_MBC1_RAM_BATTERY:
-            printf("Cart has an MBC1\n");
+            robingb_log("Cart has an MBC1\n");
             return MBC_1;
         break;
         
         case CART_TYPE_MBC2:
         case CART_TYPE_MBC2_BATTERY:
-            printf("Cart has an MBC2\n");
+            robingb_log("Cart has an MBC2\n");
             return MBC_2;
         break;
         
@@ -166,14 +169,15 @@ static Mbc_Type calculate_mbc_type(Cart_Type cart_type) {
         case CART_TYPE_MBC3_RAM_BATTERY:
         case CART_TYPE_MBC3_TIMER_BATTERY:
         case CART_TYPE_MBC3_TIMER_RAM_BATTERY:
-            printf("Cart has an MBC3\n");
+            robingb_log("Cart has an MBC3\n");
             return MBC_3;
         break;
         
         default: {
-            printf("Unrecognised cart type: %x", cart_type);
+            robingb_log("Unrecognised cart type: %x", cart_type);
             assert(false);
-        } break;
+            return MBC_NONE; /* with asserts disabled, try to run it without an MBC */
+        }
     }
 }
 
@@ -195,21 +199,21 @@ static int calculate_ram_bank_count(Cart_Type cart_type) {
         case CART_TYPE_MBC5_RUMBLE_RAM:
         case CART_TYPE_MBC5_RUMBLE_RAM_BATTERY:
         case CART_TYPE_HuC1_RAM_BATTERY:
-            printf("Cart has RAM: ");
+            robingb_log("Cart has RAM: ");
             uint8_t ram_spec = robingb_memory_read(0x0149);
             assert(ram_spec != 0x00);
             
             switch (ram_spec) {
-                case 0x01: printf("2KB (1 bank)\n"); return 1;
-                case 0x02: printf("8KB (1 bank)\n"); return 1;
-                case 0x03: printf("4 8KB banks\n"); return 4;
-                case 0x04: printf("16 8KB banks\n"); return 16;
-                case 0x05: printf("8 8KB banks\n"); return 8;
+                case 0x01: robingb_log("2KB (1 bank)\n"); return 1;
+                case 0x02: robingb_log("8KB (1 bank)\n"); return 1;
+                case 0x03: robingb_log("4 8KB banks\n"); return 4;
+                case 0x04: robingb_log("16 8KB banks\n"); return 16;
+                case 0x05: robingb_log("8 8KB banks\n"); return 8;
             };
         break;
         
         default: {
-            printf("Cart has no RAM\n");
+            robingb_log("Cart has no RAM\n");
             assert(robingb_memory_read(0x0149) == 0x00);
             return 0;
         } break;
@@ -229,7 +233,7 @@ static void init_cart_state() {
     
     /* Supported MBC types are currently MBC1, MBC3, or none (ROM only). */
     assert(cart_state.mbc_type == MBC_NONE
-        || cart_state.mbc_type == MBC_1
+        || (cart_state.mbc_type == MBC_1 && robingb_mbc1_is_supported)
         || cart_state.mbc_type == MBC_3);
     
     robingb_romb_init_additional_banks();
@@ -285,8 +289,12 @@ void robingb_memory_init() {
 }
 
 uint8_t robingb_memory_read(uint16_t address) {
-    if (address >= 0x4000 && address < 0x8000) {
+    if (robingb_mbc1_is_supported && address >= 0x4000 && address < 0x8000) {
         return robingb_romb_read_switchable_bank(address);
+    } else if (address == 0xff04 || address == 0xff05) {
+        return robingb_timer_read_register(address);
+    } else if (address == 0xff26) {
+        return robingb_audio_respond_to_status_read();
     } else {
         return robingb_memory[address];
     }
@@ -305,14 +313,29 @@ void robingb_memory_write(uint16_t address, uint8_t value) {
         perform_cart_control(address, value);
     } else if (address == 0xff00) {
         robingb_memory[address] = robingb_respond_to_joypad_register(value);
-    } else if (address == 0xff04) {
-        robingb_memory[address] = robingb_respond_to_timer_div_register();
+    } else if (address >= 0xff04 && address < 0xff08) {
+        robingb_timer_respond_to_register_write(address, value);
     } else if (address == 0xff46) {
         memcpy(&robingb_memory[0xfe00], &robingb_memory[value * 0x100], 160); /* OAM DMA transfer */
+        robingb_invalidate_object_index();
+    } else if (address >= 0x8000 && address < 0xa000) {
+        robingb_memory[address] = value;
+        robingb_respond_to_vram_write(address);
+    } else if (address >= 0xfe00 && address < 0xfea0) {
+        robingb_memory[address] = value; /* direct OAM write */
+        robingb_invalidate_object_index();
+    } else if (address >= 0xff10 && address < 0xff40) {
+        robingb_audio_respond_to_register_write(address, value);
+    } else if (address == INTERRUPT_FLAG_ADDRESS || address == INTERRUPT_ENABLE_ADDRESS) {
+        robingb_interrupts_respond_to_register_write(address, value);
+    } else if (address == LCD_CONTROL_ADDRESS || address == LCD_STATUS_ADDRESS || address == LCD_LYC_ADDRESS) {
+        robingb_lcd_respond_to_register_write(address, value);
     } else {
         robingb_memory[address] = value;
         
-        if (address >= 0xc000 && address < 0xde00) {
+        if (!robingb_echo_ram_is_supported) {
+            /* the echo isn't kept up to date */
+        } else if (address >= 0xc000 && address < 0xde00) {
             int echo_address = address-0xc000+0xe000;
             robingb_memory[echo_address] = value;
         } else if (address >= 0xe000 && address < 0xfe00) {
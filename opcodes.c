@@ -7,6 +7,76 @@
 
 uint8_t *num_cycles_for_finish;
 
+/* Instructions are fetched through a host pointer into the region of memory containing PC,
+instead of through robingb_memory_read(). The region is only looked up again when PC leaves
+it or the ROM bank is switched. */
+static struct {
+	const uint8_t *host_pointer; /* points to the byte at start_address */
+	uint16_t start_address;
+	uint16_t length; /* excludes the last 3 bytes, so that an instruction and the opcode and operand after it always fit */
+} fetch_region = {NULL, 0, 0};
+
+static const uint8_t *instruction_bytes; /* the opcode and its operands, followed by at least the next opcode and operand */
+
+void robingb_invalidate_fetch_region() {
+	fetch_region.length = 0;
+}
+
+static void update_fetch_region() {
+	uint32_t end_address;
+	
+	if (registers.pc < 0x4000) {
+		fetch_region.host_pointer = robingb_memory;
+		fetch_region.start_address = 0x0000;
+		end_address = 0x4000;
+	} else if (registers.pc < 0x8000) {
+		fetch_region.host_pointer = robingb_romb_get_switchable_bank();
+		fetch_region.start_address = 0x4000;
+		end_address = 0x8000;
+	} else if (registers.pc < 0xff00) {
+		fetch_region.host_pointer = &robingb_memory[0x8000];
+		fetch_region.start_address = 0x8000;
+		end_address = 0xff00;
+	} else if (registers.pc >= 0xff80) {
+		fetch_region.host_pointer = &robingb_memory[0xff80];
+		fetch_region.start_address = 0xff80;
+		end_address = 0x10000;
+	} else {
+		/* The I/O registers can't be read directly. */
+		fetch_region.length = 0;
+		return;
+	}
+	
+	fetch_region.length = end_address - fetch_region.start_address - 3;
+}
+
+static void fetch_instruction() {
+	static uint8_t fetched_bytes[4];
+	uint16_t offset = registers.pc - fetch_region.start_address;
+	
+	if (offset >= fetch_region.length) {
+		update_fetch_region();
+		offset = registers.pc - fetch_region.start_address;
+	}
+	
+	if (offset < fetch_region.length) {
+		instruction_bytes = &fetch_region.host_pointer[offset];
+	} else {
+		/* The instruction crosses the end of a region, or is in the I/O registers. */
+		fetched_bytes[0] = robingb_memory_read(registers.pc);
+		fetched_bytes[1] = robingb_memory_read(registers.pc+1);
+		fetched_bytes[2] = robingb_memory_read(registers.pc+2);
+		fetched_bytes[3] = robingb_memory_read(registers.pc+3);
+		instruction_bytes = fetched_bytes;
+	}
+}
+
+static uint16_t read_operand_u16() {
+	uint16_t operand;
+	memcpy(&operand, &instruction_bytes[1], 2);
+	return operand;
+}
+
 void robingb_finish_instruction(int16_t pc_increment, uint8_t num_cycles_param) {
 	registers.pc += pc_increment;
 	*num_cycles_for_finish = num_cycles_param;
@@ -113,7 +183,7 @@ INSTRUCTION static void instruction_ADC(uint8_t to_add, uint16_t pc_increment, i
 INSTRUCTION static void instruction_CALL_cond_xx(bool condition) {
 	if (condition) {
 		robingb_stack_push(registers.pc+3);
-		registers.pc = robingb_memory_read_u16(registers.pc+1);
+		registers.pc = read_operand_u16();
 		robingb_finish_instruction(0, 24);
 	} else robingb_finish_instruction(3, 12);
 }
@@ -213,6 +283,83 @@ INSTRUCTION static void instruction_SUB_u8(uint8_t subber, uint16_t pc_increment
 	robingb_finish_instruction(pc_increment, num_cycles);
 }
 
+/*
+Superinstructions: Some instructions are nearly always followed by the same kind of
+instruction, e.g. DEC B by JR NZ in a loop, or LD A,(HL+) by a store in a copy. After those,
+the next instruction is also executed in the same dispatch, provided that nothing could have
+happened in between: no interrupt is pending and no LCD or timer event falls due. The fused
+instruction must not depend on the clock, so stores to 0xff00 and above are never fused.
+*/
+
+static struct {
+	uint32_t dispatch_count;
+	uint32_t fused_counts[ROBINGB_FUSION_KIND_COUNT];
+} fusion_stats;
+
+void robingb_get_fusion_stats(uint32_t *dispatch_count, uint32_t fused_counts_out[]) {
+	if (dispatch_count) *dispatch_count = fusion_stats.dispatch_count;
+	if (fused_counts_out) memcpy(fused_counts_out, fusion_stats.fused_counts, sizeof(fusion_stats.fused_counts));
+}
+
+void robingb_reset_fusion_stats() {
+	memset(&fusion_stats, 0, sizeof(fusion_stats));
+}
+
+static bool next_instruction_can_be_fused() {
+	uint32_t next_instruction_cycle = robingb_cycle_count + *num_cycles_for_finish;
+	
+	if (robingb_interrupt_is_pending) return false;
+	
+	/* both deadlines must still be in the future when the next instruction starts */
+	return (uint32_t)(next_instruction_cycle - robingb_lcd_next_event_cycle) >= 0x80000000u
+		&& (uint32_t)(next_instruction_cycle - robingb_timer_overflow_cycle) >= 0x80000000u;
+}
+
+/* Called at the end of an instruction that didn't jump, with the instruction's length. */
+static void fuse_next_instruction(uint8_t length) {
+	const uint8_t *next_bytes = &instruction_bytes[length];
+	uint8_t num_cycles_so_far = *num_cycles_for_finish;
+	RobinGB_Fusion_Kind kind;
+	bool condition = false;
+	
+	if (!next_instruction_can_be_fused()) return;
+	
+	switch (next_bytes[0]) {
+		case 0x20: condition = (registers.f & FLAG_Z) == 0; kind = ROBINGB_FUSION_JUMP; break; /* JR NZ,s */
+		case 0x28: condition = (registers.f & FLAG_Z) != 0; kind = ROBINGB_FUSION_JUMP; break; /* JR Z,s */
+		case 0x30: condition = (registers.f & FLAG_C) == 0; kind = ROBINGB_FUSION_JUMP; break; /* JR NC,s */
+		case 0x38: condition = (registers.f & FLAG_C) != 0; kind = ROBINGB_FUSION_JUMP; break; /* JR C,s */
+		case 0xe6: kind = ROBINGB_FUSION_AND; break; /* AND x */
+		case 0x12: /* LD (DE),A */
+			if (registers.de >= 0xff00) return;
+			kind = ROBINGB_FUSION_COPY;
+			break;
+		case 0x22: /* LD (HL+),A */
+			if (registers.hl >= 0xff00) return;
+			kind = ROBINGB_FUSION_COPY;
+			break;
+		default: return;
+	}
+	
+	switch (kind) {
+		case ROBINGB_FUSION_JUMP:
+			if (condition) robingb_finish_instruction(2 + (int8_t)next_bytes[1], 12);
+			else robingb_finish_instruction(2, 8);
+			break;
+		case ROBINGB_FUSION_AND:
+			instruction_AND(next_bytes[1], 2, 8);
+			break;
+		default:
+			if (next_bytes[0] == 0x12) robingb_memory_write(registers.de, registers.a);
+			else robingb_memory_write(registers.hl++, registers.a);
+			robingb_finish_instruction(1, 8);
+			break;
+	}
+	
+	*num_cycles_for_finish += num_cycles_so_far;
+	if (robingb_instrumentation_is_enabled) fusion_stats.fused_counts[kind]++;
+}
+
 void robingb_execute_next_opcode(uint8_t *num_cycles_out) {
 	
 	if (halted) {
@@ -221,16 +368,18 @@ void robingb_execute_next_opcode(uint8_t *num_cycles_out) {
 	}
 	
 	num_cycles_for_finish = num_cycles_out;
-	uint8_t opcode = robingb_memory_read(registers.pc);
+	if (robingb_instrumentation_is_enabled) fusion_stats.dispatch_count++;
+	fetch_instruction();
+	uint8_t opcode = instruction_bytes[0];
 	
 	switch (opcode) {
 		case 0x00: DEBUG_set_opcode_name("NOP"); robingb_finish_instruction(1, 4); break;
-		case 0x01: DEBUG_set_opcode_name("LD BC,xx"); registers.bc = robingb_memory_read_u16(registers.pc+1); robingb_finish_instruction(3, 12); break;
+		case 0x01: DEBUG_set_opcode_name("LD BC,xx"); registers.bc = read_operand_u16(); robingb_finish_instruction(3, 12); break;
 		case 0x02: DEBUG_set_opcode_name("LD (BC),A"); robingb_memory_write(registers.bc, registers.a); robingb_finish_instruction(1, 8); break;
 		case 0x03: DEBUG_set_opcode_name("INC BC"); registers.bc++; robingb_finish_instruction(1, 8); break;
 		case 0x04: DEBUG_set_opcode_name("INC b"); instruction_INC_u8(&registers.b, 4); break;
-		case 0x05: DEBUG_set_opcode_name("DEC B"); instruction_DEC_u8(&registers.b, 4); break;
-		case 0x06: DEBUG_set_opcode_name("LD B,x"); registers.b = robingb_memory_read(registers.pc+1); robingb_finish_instruction(2, 8); break;
+		case 0x05: DEBUG_set_opcode_name("DEC B"); instruction_DEC_u8(&registers.b, 4); fuse_next_instruction(1); break;
+		case 0x06: DEBUG_set_opcode_name("LD B,x"); registers.b = instruction_bytes[1]; robingb_finish_instruction(2, 8); break;
 		case 0x07: { DEBUG_set_opcode_name("RLCA");
 			if (registers.a & robingb_bit(7)) {
 				registers.f |= FLAG_C;
@@ -248,13 +397,13 @@ void robingb_execute_next_opcode(uint8_t *num_cycles_out) {
 			
 			robingb_finish_instruction(1, 4);
 		} break;
-		case 0x08: DEBUG_set_opcode_name("LD (xx),SP"); robingb_memory_write_u16(robingb_memory_read_u16(registers.pc+1), registers.sp); robingb_finish_instruction(3, 20); break;
+		case 0x08: DEBUG_set_opcode_name("LD (xx),SP"); robingb_memory_write_u16(read_operand_u16(), registers.sp); robingb_finish_instruction(3, 20); break;
 		case 0x09: DEBUG_set_opcode_name("ADD HL,BC"); instruction_ADD_HL_u16(registers.bc); break;
 		case 0x0a: DEBUG_set_opcode_name("LD A,(BC)"); registers.a = robingb_memory_read(registers.bc); robingb_finish_instruction(1, 8); break;
 		case 0x0b: DEBUG_set_opcode_name("DEC BC"); registers.bc--; robingb_finish_instruction(1, 8); break;
 		case 0x0c: DEBUG_set_opcode_name("INC C"); instruction_INC_u8(&registers.c, 4); break;
-		case 0x0d: DEBUG_set_opcode_name("DEC C"); instruction_DEC_u8(&registers.c, 4); break;
-		case 0x0e: DEBUG_set_opcode_name("LD C,x"); registers.c = robingb_memory_read(registers.pc+1); robingb_finish_instruction(2, 8); break;
+		case 0x0d: DEBUG_set_opcode_name("DEC C"); instruction_DEC_u8(&registers.c, 4); fuse_next_instruction(1); break;
+		case 0x0e: DEBUG_set_opcode_name("LD C,x"); registers.c = instruction_bytes[1]; robingb_finish_instruction(2, 8); break;
 		case 0x0f: { DEBUG_set_opcode_name("RRCA");
 			
 			/* different flag manipulation to RRC!!! */
@@ -277,12 +426,12 @@ void robingb_execute_next_opcode(uint8_t *num_cycles_out) {
 		/* TODO: Apparently STOP is like HALT except the LCD is inoperational as well, and
 		the "stopped" state is only exited when a button is pressed. Look for better documentation
 		on it. */
-		case 0x11: DEBUG_set_opcode_name("LD DE,xx"); registers.de = robingb_memory_read_u16(registers.pc+1); robingb_finish_instruction(3, 12); break;
+		case 0x11: DEBUG_set_opcode_name("LD DE,xx"); registers.de = read_operand_u16(); robingb_finish_instruction(3, 12); break;
 		case 0x12: DEBUG_set_opcode_name("LD (DE),A"); robingb_memory_write(registers.de, registers.a); robingb_finish_instruction(1, 8); break;
 		case 0x13: DEBUG_set_opcode_name("INC DE"); registers.de++; robingb_finish_instruction(1, 8); break;
 		case 0x14: DEBUG_set_opcode_name("INC D"); instruction_INC_u8(&registers.d, 4); break;
-		case 0x15: DEBUG_set_opcode_name("DEC D"); instruction_DEC_u8(&registers.d, 4); break;
-		case 0x16: DEBUG_set_opcode_name("LD D,x"); registers.d = robingb_memory_read(registers.pc+1); robingb_finish_instruction(2, 8); break;
+		case 0x15: DEBUG_set_opcode_name("DEC D"); instruction_DEC_u8(&registers.d, 4); fuse_next_instruction(1); break;
+		case 0x16: DEBUG_set_opcode_name("LD D,x"); registers.d = instruction_bytes[1]; robingb_finish_instruction(2, 8); break;
 		case 0x17: { DEBUG_set_opcode_name("RLA");
 			bool prev_carry = registers.f & FLAG_C;
 			
@@ -299,13 +448,13 @@ void robingb_execute_next_opcode(uint8_t *num_cycles_out) {
 			
 			robingb_finish_instruction(1, 4);
 		} break;
-		case 0x18: DEBUG_set_opcode_name("JR %i(d)"); robingb_finish_instruction(2 + (int8_t)robingb_memory_read(registers.pc+1), 12); break;
+		case 0x18: DEBUG_set_opcode_name("JR %i(d)"); robingb_finish_instruction(2 + (int8_t)instruction_bytes[1], 12); break;
 		case 0x19: DEBUG_set_opcode_name("ADD HL,DE"); instruction_ADD_HL_u16(registers.de); break;
-		case 0x1a: DEBUG_set_opcode_name("LD A,(DE)"); registers.a = robingb_memory_read(registers.de); robingb_finish_instruction(1, 8); break;
+		case 0x1a: DEBUG_set_opcode_name("LD A,(DE)"); registers.a = robingb_memory_read(registers.de); robingb_finish_instruction(1, 8); fuse_next_instruction(1); break;
 		case 0x1b: DEBUG_set_opcode_name("DEC DE"); registers.de--; robingb_finish_instruction(1, 8); break;
 		case 0x1c: DEBUG_set_opcode_name("INC E"); instruction_INC_u8(&registers.e, 4); break;
-		case 0x1d: DEBUG_set_opcode_name("DEC E"); instruction_DEC_u8(&registers.e, 4); break;
-		case 0x1e: DEBUG_set_opcode_name("LD E,x"); registers.e = robingb_memory_read(registers.pc+1); robingb_finish_instruction(2, 8); break;
+		case 0x1d: DEBUG_set_opcode_name("DEC E"); instruction_DEC_u8(&registers.e, 4); fuse_next_instruction(1); break;
+		case 0x1e: DEBUG_set_opcode_name("LD E,x"); registers.e = instruction_bytes[1]; robingb_finish_instruction(2, 8); break;
 		case 0x1f: { DEBUG_set_opcode_name("RRA");
 			bool prev_carry = registers.f & FLAG_C;
 			
@@ -324,15 +473,15 @@ void robingb_execute_next_opcode(uint8_t *num_cycles_out) {
 		} break;
 		case 0x20: { DEBUG_set_opcode_name("JR NZ,s");
 			if (registers.f & FLAG_Z) robingb_finish_instruction(2, 8);
-			else robingb_finish_instruction(2 + (int8_t)robingb_memory_read(registers.pc+1), 12);
+			else robingb_finish_instruction(2 + (int8_t)instruction_bytes[1], 12);
 		} break;
-		case 0x21: DEBUG_set_opcode_name("LD HL,xx"); registers.hl = robingb_memory_read_u16(registers.pc+1); robingb_finish_instruction(3, 12); break;
+		case 0x21: DEBUG_set_opcode_name("LD HL,xx"); registers.hl = read_operand_u16(); robingb_finish_instruction(3, 12); break;
 		case 0x22: DEBUG_set_opcode_name("LD (HL+),A"); robingb_memory_write(registers.hl++, registers.a); robingb_finish_instruction(1, 8); break;
 		case 0x23: DEBUG_set_opcode_name("INC HL");  registers.hl++; robingb_finish_instruction(1, 8); break;
 		case 0x24: DEBUG_set_opcode_name("INC H"); instruction_INC_u8(&registers.h, 4); break;
 		case 0x25: DEBUG_set_opcode_name("DEC H"); instruction_DEC_u8(&registers.h, 4); break;
 		case 0x26: { DEBUG_set_opcode_name("LD H,x");
-			registers.h = robingb_memory_read(registers.pc+1);
+			registers.h = instruction_bytes[1];
 			robingb_finish_instruction(2, 8);
 		} break;
 		case 0x27: { DEBUG_set_opcode_name("DAA");
@@ -359,15 +508,15 @@ void robingb_execute_next_opcode(uint8_t *num_cycles_out) {
 			robingb_finish_instruction(1, 4);
 		} break;
 		case 0x28: { DEBUG_set_opcode_name("JR Z,s");
-			if (registers.f & FLAG_Z) robingb_finish_instruction(2 + (int8_t)robingb_memory_read(registers.pc+1), 12);
+			if (registers.f & FLAG_Z) robingb_finish_instruction(2 + (int8_t)instruction_bytes[1], 12);
 			else robingb_finish_instruction(2, 8);
 		} break;
 		case 0x29: DEBUG_set_opcode_name("ADD HL,HL"); instruction_ADD_HL_u16(registers.hl); break;
-		case 0x2a: DEBUG_set_opcode_name("LD A,(HL+)"); registers.a = robingb_memory_read(registers.hl++); robingb_finish_instruction(1, 8); break;
+		case 0x2a: DEBUG_set_opcode_name("LD A,(HL+)"); registers.a = robingb_memory_read(registers.hl++); robingb_finish_instruction(1, 8); fuse_next_instruction(1); break;
 		case 0x2b: DEBUG_set_opcode_name("DEC HL"); registers.hl--; robingb_finish_instruction(1, 8); break;
 		case 0x2c: DEBUG_set_opcode_name("INC L"); instruction_INC_u8(&registers.l, 4); break;
 		case 0x2d: DEBUG_set_opcode_name("DEC L"); instruction_DEC_u8(&registers.l, 4); break;
-		case 0x2e: DEBUG_set_opcode_name("LD L,x"); registers.l = robingb_memory_read(registers.pc+1); robingb_finish_instruction(2, 8); break;
+		case 0x2e: DEBUG_set_opcode_name("LD L,x"); registers.l = instruction_bytes[1]; robingb_finish_instruction(2, 8); break;
 		case 0x2f: { DEBUG_set_opcode_name("CPL");
 			registers.a ^= 0xff;
 			registers.f |= FLAG_N;
@@ -375,10 +524,10 @@ void robingb_execute_next_opcode(uint8_t *num_cycles_out) {
 			robingb_finish_instruction(1, 4);
 		} break;
 		case 0x30: { DEBUG_set_opcode_name("JR NC,s");
-			if ((registers.f & FLAG_C) == 0) robingb_finish_instruction(2 + (int8_t)robingb_memory_read(registers.pc+1), 12);
+			if ((registers.f & FLAG_C) == 0) robingb_finish_instruction(2 + (int8_t)instruction_bytes[1], 12);
 			else robingb_finish_instruction(2, 8);
 		} break;
-		case 0x31: DEBUG_set_opcode_name("LD SP,xx"); registers.sp = robingb_memory_read_u16(registers.pc+1); robingb_finish_instruction(3, 12); break;
+		case 0x31: DEBUG_set_opcode_name("LD SP,xx"); registers.sp = read_operand_u16(); robingb_finish_instruction(3, 12); break;
 		case 0x32: DEBUG_set_opcode_name("LD (HL-),A"); robingb_memory_write(registers.hl--, registers.a); robingb_finish_instruction(1, 8); break;
 		case 0x33: DEBUG_set_opcode_name("INC SP"); registers.sp++; robingb_finish_instruction(1, 8); break;
 		case 0x34: { DEBUG_set_opcode_name("INC (HL)");
@@ -391,7 +540,7 @@ void robingb_execute_next_opcode(uint8_t *num_cycles_out) {
 			instruction_DEC_u8(&hl_value, 12);
 			robingb_memory_write(registers.hl, hl_value);
 		} break;
-		case 0x36: DEBUG_set_opcode_name("LD (HL),x"); robingb_memory_write(registers.hl, robingb_memory_read(registers.pc+1)); robingb_finish_instruction(2, 12); break;
+		case 0x36: DEBUG_set_opcode_name("LD (HL),x"); robingb_memory_write(registers.hl, instruction_bytes[1]); robingb_finish_instruction(2, 12); break;
 		case 0x37: { DEBUG_set_opcode_name("SCF");
 			registers.f &= ~FLAG_N;
 			registers.f &= ~FLAG_H;
@@ -399,15 +548,15 @@ void robingb_execute_next_opcode(uint8_t *num_cycles_out) {
 			robingb_finish_instruction(1, 4);
 		} break;
 		case 0x38: { DEBUG_set_opcode_name("JR C,s");
-			if (registers.f & FLAG_C) robingb_finish_instruction(2 + (int8_t)robingb_memory_read(registers.pc+1), 12);
+			if (registers.f & FLAG_C) robingb_finish_instruction(2 + (int8_t)instruction_bytes[1], 12);
 			else robingb_finish_instruction(2, 8);
 		} break;
 		case 0x39: DEBUG_set_opcode_name("ADD HL,SP"); instruction_ADD_HL_u16(registers.sp); break;
 		case 0x3a: DEBUG_set_opcode_name("LD A,(HL-)"); registers.a = robingb_memory_read(registers.hl--); robingb_finish_instruction(1, 8); break;
 		case 0x3b: DEBUG_set_opcode_name("DEC SP"); registers.sp--; robingb_finish_instruction(1, 8); break;
 		case 0x3c: DEBUG_set_opcode_name("INC A"); instruction_INC_u8(&registers.a, 4); break;
-		case 0x3d: DEBUG_set_opcode_name("DEC A"); instruction_DEC_u8(&registers.a, 4); break;
-		case 0x3e: DEBUG_set_opcode_name("LD A,x"); registers.a = robingb_memory_read(registers.pc+1); robingb_finish_instruction(2, 8); break;
+		case 0x3d: DEBUG_set_opcode_name("DEC A"); instruction_DEC_u8(&registers.a, 4); fuse_next_instruction(1); break;
+		case 0x3e: DEBUG_set_opcode_name("LD A,x"); registers.a = instruction_bytes[1]; robingb_finish_instruction(2, 8); break;
 		case 0x3f: { DEBUG_set_opcode_name("CCF");
 			registers.f &= ~FLAG_N;
 			registers.f &= ~FLAG_H;
@@ -524,7 +673,7 @@ void robingb_execute_next_opcode(uint8_t *num_cycles_out) {
 		case 0xa4: DEBUG_set_opcode_name("AND H"); instruction_AND(registers.h, 1, 4); break;
 		case 0xa5: DEBUG_set_opcode_name("AND L"); instruction_AND(registers.l, 1, 4); break;
 		case 0xa6: DEBUG_set_opcode_name("AND (HL)"); instruction_AND(robingb_memory_read(registers.hl), 1, 8); break;
-		case 0xa7: DEBUG_set_opcode_name("AND A"); instruction_AND(registers.a, 1, 4); break;
+		case 0xa7: DEBUG_set_opcode_name("AND A"); instruction_AND(registers.a, 1, 4); fuse_next_instruction(1); break;
 		case 0xa8: DEBUG_set_opcode_name("XOR B"); instruction_XOR(registers.b, 4); break;
 		case 0xa9: DEBUG_set_opcode_name("XOR C"); instruction_XOR(registers.c, 4); break;
 		case 0xaa: DEBUG_set_opcode_name("XOR D"); instruction_XOR(registers.d, 4); break;
@@ -533,14 +682,14 @@ void robingb_execute_next_opcode(uint8_t *num_cycles_out) {
 		case 0xad: DEBUG_set_opcode_name("XOR L"); instruction_XOR(registers.l, 4); break;
 		case 0xae: DEBUG_set_opcode_name("XOR (HL)"); instruction_XOR(robingb_memory_read(registers.hl), 8); break;
 		case 0xaf: DEBUG_set_opcode_name("XOR A"); instruction_XOR(registers.a, 4); break;
-		case 0xb0: DEBUG_set_opcode_name("OR B"); instruction_OR(registers.b, 1, 4); break;
-		case 0xb1: DEBUG_set_opcode_name("OR C"); instruction_OR(registers.c, 1, 4); break;
+		case 0xb0: DEBUG_set_opcode_name("OR B"); instruction_OR(registers.b, 1, 4); fuse_next_instruction(1); break;
+		case 0xb1: DEBUG_set_opcode_name("OR C"); instruction_OR(registers.c, 1, 4); fuse_next_instruction(1); break;
 		case 0xb2: DEBUG_set_opcode_name("OR D"); instruction_OR(registers.d, 1, 4); break;
 		case 0xb3: DEBUG_set_opcode_name("OR E"); instruction_OR(registers.e, 1, 4); break;
 		case 0xb4: DEBUG_set_opcode_name("OR H"); instruction_OR(registers.h, 1, 4); break;
 		case 0xb5: DEBUG_set_opcode_name("OR L"); instruction_OR(registers.l, 1, 4); break;
 		case 0xb6: DEBUG_set_opcode_name("OR (HL)"); instruction_OR(robingb_memory_read(registers.hl), 1, 8); break;
-		case 0xb7: DEBUG_set_opcode_name("OR A"); instruction_OR(registers.a, 1, 4); break;
+		case 0xb7: DEBUG_set_opcode_name("OR A"); instruction_OR(registers.a, 1, 4); fuse_next_instruction(1); break;
 		case 0xb8: DEBUG_set_opcode_name("CP B"); instruction_CP(registers.b, 1, 4); break;
 		case 0xb9: DEBUG_set_opcode_name("CP C"); instruction_CP(registers.c, 1, 4); break;
 		case 0xba: DEBUG_set_opcode_name("CP D"); instruction_CP(registers.d, 1, 4); break;
@@ -562,14 +711,14 @@ void robingb_execute_next_opcode(uint8_t *num_cycles_out) {
 		} break;
 		case 0xc2: { DEBUG_set_opcode_name("JP NZ,xx");
 			if ((registers.f & FLAG_Z) == 0) {
-				registers.pc = robingb_memory_read_u16(registers.pc+1);
+				registers.pc = read_operand_u16();
 				robingb_finish_instruction(0, 16);
 			} else {
 				robingb_finish_instruction(3, 12);
 			}
 		} break;
 		case 0xc3: { DEBUG_set_opcode_name("JP xx");
-			registers.pc = robingb_memory_read_u16(registers.pc+1);
+			registers.pc = read_operand_u16();
 			robingb_finish_instruction(0, 16);
 		} break;
 		case 0xc4: DEBUG_set_opcode_name("CALL NZ,xx"); instruction_CALL_cond_xx((registers.f & FLAG_Z) == 0); break;
@@ -577,7 +726,7 @@ void robingb_execute_next_opcode(uint8_t *num_cycles_out) {
 			robingb_stack_push(registers.bc);
 			robingb_finish_instruction(1, 16);
 		} break;
-		case 0xc6: DEBUG_set_opcode_name("ADD A,x"); instruction_ADD_A_u8(robingb_memory_read(registers.pc+1), 2, 8); break;
+		case 0xc6: DEBUG_set_opcode_name("ADD A,x"); instruction_ADD_A_u8(instruction_bytes[1], 2, 8); break;
 		case 0xc7: DEBUG_set_opcode_name("RST 00h"); instruction_RST(0x00); break;
 		case 0xc8: { DEBUG_set_opcode_name("RET Z");
 			if (registers.f & FLAG_Z) {
@@ -591,16 +740,16 @@ void robingb_execute_next_opcode(uint8_t *num_cycles_out) {
 		} break;
 		case 0xca: { DEBUG_set_opcode_name("JP Z,xx");
 			if (registers.f & FLAG_Z) {
-				registers.pc = robingb_memory_read_u16(registers.pc+1);
+				registers.pc = read_operand_u16();
 				robingb_finish_instruction(0, 16);
 			} else robingb_finish_instruction(3, 12);
 		} break;
-		case 0xcb: robingb_execute_cb_opcode(); break;
+		case 0xcb: robingb_execute_cb_opcode(instruction_bytes[1]); break;
 		case 0xcc: DEBUG_set_opcode_name("CALL Z,xx"); instruction_CALL_cond_xx(registers.f & FLAG_Z); break;
 		case 0xcd: { DEBUG_set_opcode_name("CALL xx");
 			instruction_CALL_cond_xx(true); break;
 		} break;
-		case 0xce: DEBUG_set_opcode_name("ADC A,x"); instruction_ADC(robingb_memory_read(registers.pc+1), 2, 8); break;
+		case 0xce: DEBUG_set_opcode_name("ADC A,x"); instruction_ADC(instruction_bytes[1], 2, 8); break;
 		case 0xcf: DEBUG_set_opcode_name("RST 08h"); instruction_RST(0x08); break;
 		case 0xd0: { DEBUG_set_opcode_name("RET NC");
 			if ((registers.f & FLAG_C) == false) {
@@ -614,7 +763,7 @@ void robingb_execute_next_opcode(uint8_t *num_cycles_out) {
 		} break;
 		case 0xd2: { DEBUG_set_opcode_name("JP NC,xx");
 			if ((registers.f & FLAG_C) == 0) {
-				registers.pc = robingb_memory_read_u16(registers.pc+1);
+				registers.pc = read_operand_u16();
 				robingb_finish_instruction(0, 16);
 			} else {
 				robingb_finish_instruction(3, 12);
@@ -626,7 +775,7 @@ void robingb_execute_next_opcode(uint8_t *num_cycles_out) {
 			robingb_stack_push(registers.de);
 			robingb_finish_instruction(1, 16);
 		} break;
-		case 0xd6: DEBUG_set_opcode_name("SUB x"); instruction_SUB_u8(robingb_memory_read(registers.pc+1), 2, 8); break;
+		case 0xd6: DEBUG_set_opcode_name("SUB x"); instruction_SUB_u8(instruction_bytes[1], 2, 8); break;
 		case 0xd7: DEBUG_set_opcode_name("RST 10h"); instruction_RST(0x10); break;
 		case 0xd8: { DEBUG_set_opcode_name("RET C");
 			if (registers.f & FLAG_C) {
@@ -636,22 +785,22 @@ void robingb_execute_next_opcode(uint8_t *num_cycles_out) {
 		} break;
 		case 0xd9: { DEBUG_set_opcode_name("RETI");
 			registers.pc = robingb_stack_pop();
-			registers.ime = true;
+			robingb_set_interrupt_master_enable(true);
 			robingb_finish_instruction(0, 16);
 		} break;
 		case 0xda: { DEBUG_set_opcode_name("JP C,xx");
 			if (registers.f & FLAG_C) {
-				registers.pc = robingb_memory_read_u16(registers.pc+1);
+				registers.pc = read_operand_u16();
 				robingb_finish_instruction(0, 16);
 			} else robingb_finish_instruction(3, 12);
 		} break;
 		case 0xdb: DEBUG_set_opcode_name("(invalid)"); assert(false); break;
 		case 0xdc: DEBUG_set_opcode_name("CALL C,xx"); instruction_CALL_cond_xx(registers.f & FLAG_C); break;
 		case 0xdd: DEBUG_set_opcode_name("(invalid)"); assert(false); break;
-		case 0xde: DEBUG_set_opcode_name("SBC A,x"); instruction_SBC(robingb_memory_read(registers.pc+1), 2, 8); break;
+		case 0xde: DEBUG_set_opcode_name("SBC A,x"); instruction_SBC(instruction_bytes[1], 2, 8); break;
 		case 0xdf: DEBUG_set_opcode_name("RST 18H"); instruction_RST(0x18); break;
 		case 0xe0: { DEBUG_set_opcode_name("LDH (ff00+x),A");
-			robingb_memory_write(0xff00 + robingb_memory_read(registers.pc+1), registers.a);
+			robingb_memory_write(0xff00 + instruction_bytes[1], registers.a);
 			robingb_finish_instruction(2, 12);
 		} break;
 		case 0xe1: { DEBUG_set_opcode_name("POP HL");
@@ -668,10 +817,10 @@ void robingb_execute_next_opcode(uint8_t *num_cycles_out) {
 			robingb_stack_push(registers.hl);
 			robingb_finish_instruction(1, 16);
 		} break;
-		case 0xe6: DEBUG_set_opcode_name("AND x"); instruction_AND(robingb_memory_read(registers.pc+1), 2, 8); break;
+		case 0xe6: DEBUG_set_opcode_name("AND x"); instruction_AND(instruction_bytes[1], 2, 8); fuse_next_instruction(2); break;
 		case 0xe7: DEBUG_set_opcode_name("RST 20H"); instruction_RST(0x20); break;
 		case 0xe8: { DEBUG_set_opcode_name("ADD SP,s");
-			int8_t signed_byte = robingb_memory_read(registers.pc+1);
+			int8_t signed_byte = instruction_bytes[1];
 			
 			/* TODO: Investigate what happens with this double XOR. */
 			uint16_t xor_result = registers.sp ^ signed_byte ^ (registers.sp + signed_byte);
@@ -689,14 +838,14 @@ void robingb_execute_next_opcode(uint8_t *num_cycles_out) {
 			robingb_finish_instruction(0, 4);
 		} break;
 		case 0xea: { DEBUG_set_opcode_name("LD (x),A");
-			robingb_memory_write(robingb_memory_read_u16(registers.pc+1), registers.a);
+			robingb_memory_write(read_operand_u16(), registers.a);
 			robingb_finish_instruction(3, 16);
 		} break;
 		case 0xeb: DEBUG_set_opcode_name("(invalid)"); break;
 		case 0xec: DEBUG_set_opcode_name("(invalid)"); break;
 		case 0xed: DEBUG_set_opcode_name("(invalid)"); break;
 		case 0xee: { DEBUG_set_opcode_name("XOR x");
-			uint8_t byte_0 = robingb_memory_read(registers.pc+1);
+			uint8_t byte_0 = instruction_bytes[1];
 			registers.a ^= byte_0;
 			
 			if (registers.a == 0) registers.f |= FLAG_Z;
@@ -709,8 +858,9 @@ void robingb_execute_next_opcode(uint8_t *num_cycles_out) {
 		} break;
 		case 0xef: DEBUG_set_opcode_name("RST 28H"); instruction_RST(0x28); break;
 		case 0xf0: { DEBUG_set_opcode_name("LDH A,(0xff00+x)");
-			registers.a = robingb_memory_read(0xff00 + robingb_memory_read(registers.pc+1));
+			registers.a = robingb_memory_read(0xff00 + instruction_bytes[1]);
 			robingb_finish_instruction(2, 12);
+			fuse_next_instruction(2);
 		} break;
 		case 0xf1: { DEBUG_set_opcode_name("POP AF");
 			registers.af = robingb_stack_pop() & 0xfff0; /* lower nybble of F must stay 0 */
@@ -721,7 +871,7 @@ void robingb_execute_next_opcode(uint8_t *num_cycles_out) {
 			robingb_finish_instruction(1, 8);
 		} break;
 		case 0xf3: { DEBUG_set_opcode_name("DI");
-			registers.ime = false;
+			robingb_set_interrupt_master_enable(false);
 			robingb_finish_instruction(1, 4);
 		} break;
 		case 0xf4: DEBUG_set_opcode_name("(invalid)"); break;
@@ -729,10 +879,10 @@ void robingb_execute_next_opcode(uint8_t *num_cycles_out) {
 			robingb_stack_push(registers.af);
 			robingb_finish_instruction(1, 16);
 		} break;
-		case 0xf6: DEBUG_set_opcode_name("OR x"); instruction_OR(robingb_memory_read(registers.pc+1), 2, 8); break;
+		case 0xf6: DEBUG_set_opcode_name("OR x"); instruction_OR(instruction_bytes[1], 2, 8); break;
 		case 0xf7: DEBUG_set_opcode_name("RST 30H"); instruction_RST(0x30); break;
 		case 0xf8: { DEBUG_set_opcode_name("LDHL SP,s");
-			int8_t signed_byte = robingb_memory_read(registers.pc+1);
+			int8_t signed_byte = instruction_bytes[1];
 			
 			/* TODO: Investigate what happens with this double XOR. */
 			uint16_t xor_result = registers.sp ^ signed_byte ^ (registers.sp + signed_byte);
@@ -750,18 +900,18 @@ void robingb_execute_next_opcode(uint8_t *num_cycles_out) {
 			robingb_finish_instruction(1, 8);
 		} break;
 		case 0xfa: { DEBUG_set_opcode_name("LD A,(xx)");
-			uint16_t address = robingb_memory_read_u16(registers.pc+1);
+			uint16_t address = read_operand_u16();
 			registers.a = robingb_memory_read(address);
 			robingb_finish_instruction(3, 16);
 		} break;
 		case 0xfb: { DEBUG_set_opcode_name("IE");
-			registers.ime = true;
+			robingb_set_interrupt_master_enable(true);
 			robingb_finish_instruction(1, 4);
 		} break;
 		case 0xfc: DEBUG_set_opcode_name("(invalid)"); break;
 		case 0xfd: DEBUG_set_opcode_name("(invalid)"); break;
 		case 0xfe: { DEBUG_set_opcode_name("CP x");
-			uint8_t byte_0 = robingb_memory_read(registers.pc+1);
+			uint8_t byte_0 = instruction_bytes[1];
 			
 			if (negate_produces_u8_half_carry(registers.a, byte_0, false)) registers.f |= FLAG_H;
 			else registers.f &= ~FLAG_H;
@@ -775,10 +925,11 @@ void robingb_execute_next_opcode(uint8_t *num_cycles_out) {
 			if (sub_result == 0) registers.f |= FLAG_Z;
 			else registers.f &= ~FLAG_Z;
 			robingb_finish_instruction(2, 8);
+			fuse_next_instruction(2);
 		} break;
 		case 0xff: DEBUG_set_opcode_name("RST 38H"); instruction_RST(0x38); break;
 		default: {
-			printf("Unknown opcode %x at address %x\n", opcode, registers.pc);
+			robingb_log("Unknown opcode %x at address %x\n", opcode, registers.pc);
 			assert(false);
 		} break;
 	}
@@ -1,535 +1,103 @@
 #include "internal.h"
-#include <assert.h>
-#include <stdio.h>
-
-#define INSTRUCTION static
-
-INSTRUCTION void instruction_RL(uint8_t *byte_to_rotate, uint8_t num_cycles) {
-    bool prev_carry = registers.f & FLAG_C;
-    
-    if ((*byte_to_rotate) & robingb_bit(7)) registers.f |= FLAG_C;
-    else registers.f &= ~FLAG_C;
-    
-    *byte_to_rotate <<= 1;
-    
-    if (prev_carry) *byte_to_rotate |= robingb_bit(0);
-    else *byte_to_rotate &= ~robingb_bit(0);
-    
-    if (*byte_to_rotate == 0) registers.f |= FLAG_Z;
-    else registers.f &= ~FLAG_Z;
-    
-    registers.f &= ~FLAG_N;
-    registers.f &= ~FLAG_H;
-    
-    robingb_finish_instruction(1, num_cycles);
-}
-
-INSTRUCTION void instruction_RLC(uint8_t *byte_to_rotate, uint8_t num_cycles) {
-    if ((*byte_to_rotate) & robingb_bit(7)) {
-        registers.f |= FLAG_C;
-        *byte_to_rotate <<= 1;
-        *byte_to_rotate |= robingb_bit(0);
-    } else {
-        registers.f &= ~FLAG_C;
-        *byte_to_rotate <<= 1;
-        *byte_to_rotate &= ~robingb_bit(0);
+#include <stddef.h>
+
+/*
+The CB-prefixed opcodes are regular enough to be decoded rather than listed:
+- The operand is (opcode & 7), in the order B, C, D, E, H, L, (HL), A.
+- For opcodes 0x00 to 0x3f, (opcode >> 3) & 7 selects one of the 8 rotate and shift operations.
+- For 0x40 to 0xff, (opcode >> 6) selects BIT, RES or SET, and (opcode >> 3) & 7 is the bit index.
+
+Define ROBINGB_UNROLLED_CB_OPCODES in robingb_config.h to have the preprocessor generate a
+256-case switch from the same code instead. The compiler folds each case's decoding away, so
+each opcode needs fewer branches, but the code is about 20 times bigger.
+*/
+
+#define HL_OPERAND_INDEX 6
+
+static uint8_t *const operand_registers[8] = {
+    &registers.b, &registers.c, &registers.d, &registers.e,
+    &registers.h, &registers.l, NULL, &registers.a
+};
+
+/* RLC, RRC, RL, RR, SLA, SRA, SWAP and SRL, in opcode order */
+static uint8_t rotate_or_shift(uint8_t operation, uint8_t value) {
+    uint8_t result;
+    bool carry;
+    
+    switch (operation) {
+        case 0: result = (value << 1) | (value >> 7); carry = value & 0x80; break;
+        case 1: result = (value >> 1) | (value << 7); carry = value & 0x01; break;
+        case 2: result = (value << 1) | ((registers.f & FLAG_C) ? 0x01 : 0x00); carry = value & 0x80; break;
+        case 3: result = (value >> 1) | ((registers.f & FLAG_C) ? 0x80 : 0x00); carry = value & 0x01; break;
+        case 4: result = value << 1; carry = value & 0x80; break;
+        case 5: result = (value >> 1) | (value & 0x80); carry = value & 0x01; break; /* bit 7 stays the same */
+        case 6: result = (value >> 4) | (value << 4); carry = false; break;
+        default: result = value >> 1; carry = value & 0x01; break;
     }
     
-    if (*byte_to_rotate == 0) registers.f |= FLAG_Z;
-    else registers.f &= ~FLAG_Z;
-    
-    registers.f &= ~FLAG_N;
-    registers.f &= ~FLAG_H;
-    
-    robingb_finish_instruction(1, num_cycles);
-}
-
-INSTRUCTION void instruction_RRC(uint8_t *byte_to_rotate, uint8_t num_cycles) {
-    if ((*byte_to_rotate) & robingb_bit(0)) {
-        registers.f |= FLAG_C;
-        *byte_to_rotate >>= 1;
-        *byte_to_rotate |= robingb_bit(7);
-    } else {
-        registers.f &= ~FLAG_C;
-        *byte_to_rotate >>= 1;
-        *byte_to_rotate &= ~robingb_bit(7);
-    }
-    
-    if (*byte_to_rotate == 0) registers.f |= FLAG_Z;
-    else registers.f &= ~FLAG_Z;
-    
-    registers.f &= ~FLAG_N;
-    registers.f &= ~FLAG_H;
-    
-    robingb_finish_instruction(1, num_cycles);
-}
-
-INSTRUCTION void instruction_RR(uint8_t *byte_to_rotate, uint8_t num_cycles) {
-    bool prev_carry = registers.f & FLAG_C;
-    
-    if ((*byte_to_rotate) & robingb_bit(0)) registers.f |= FLAG_C;
-    else registers.f &= ~FLAG_C;
-    
-    *byte_to_rotate >>= 1;
-    
-    if (prev_carry) *byte_to_rotate |= robingb_bit(7);
-    
-    if (*byte_to_rotate == 0) registers.f |= FLAG_Z;
-    else registers.f &= ~FLAG_Z;
-    
-    registers.f &= ~FLAG_N;
-    registers.f &= ~FLAG_H;
-    
-    robingb_finish_instruction(1, num_cycles);
-}
-
-INSTRUCTION void instruction_SLA(uint8_t *byte_to_shift) {
-    if ((*byte_to_shift) & robingb_bit(7)) registers.f |= FLAG_C;
-    else registers.f &= ~FLAG_C;
-    
-    *byte_to_shift <<= 1;
-    *byte_to_shift &= ~robingb_bit(0); /* bit 0 should become 0. */
-    
-    if ((*byte_to_shift) == 0) registers.f |= FLAG_Z;
-    else registers.f &= ~FLAG_Z;
-    
-    registers.f &= ~FLAG_N;
-    registers.f &= ~FLAG_H;
-    
-    robingb_finish_instruction(1, 8);
-}
-
-INSTRUCTION void instruction_SRA(uint8_t *byte_to_shift, uint8_t num_cycles) {
-    if ((*byte_to_shift) & robingb_bit(0)) registers.f |= FLAG_C;
-    else registers.f &= ~FLAG_C;
-    
-    *byte_to_shift >>= 1;
-    *byte_to_shift |= ((*byte_to_shift) & robingb_bit(6)) << 1; /* bit 7 should stay the same. */
-    
-    if ((*byte_to_shift) == 0) registers.f |= FLAG_Z;
-    else registers.f &= ~FLAG_Z;
-    
-    registers.f &= ~FLAG_N;
-    registers.f &= ~FLAG_H;
-    
-    robingb_finish_instruction(1, num_cycles);
-}
-
-INSTRUCTION void instruction_SWAP(uint8_t *byte_to_swap, uint8_t num_cycles) {
-    uint8_t upper_4_bits = (*byte_to_swap) & 0xf0;
-    uint8_t lower_4_bits = (*byte_to_swap) & 0x0f;
-    *byte_to_swap = upper_4_bits >> 4;
-    *byte_to_swap |= lower_4_bits << 4;
+    registers.f &= ~(FLAG_Z | FLAG_N | FLAG_H | FLAG_C);
+    if (result == 0) registers.f |= FLAG_Z;
+    if (carry) registers.f |= FLAG_C;
     
-    if (*byte_to_swap == 0) registers.f |= FLAG_Z;
-    else registers.f &= ~FLAG_Z;
-    registers.f &= ~FLAG_N;
-    registers.f &= ~FLAG_H;
-    registers.f &= ~FLAG_C;
-    robingb_finish_instruction(1, num_cycles);
+    return result;
 }
 
-INSTRUCTION void instruction_SRL(uint8_t *byte_to_shift, uint8_t num_cycles) {
-    if ((*byte_to_shift) & robingb_bit(0)) registers.f |= FLAG_C;
-    else registers.f &= ~FLAG_C;
-    
-    *byte_to_shift >>= 1; /* bit 7 becomes 0. */
-    assert(((*byte_to_shift) & robingb_bit(7)) == false);
-    
-    if ((*byte_to_shift) == 0) registers.f |= FLAG_Z;
-    else registers.f &= ~FLAG_Z;
-    
-    registers.f &= ~FLAG_N;
-    registers.f &= ~FLAG_H;
-    
-    robingb_finish_instruction(1, num_cycles);
-}
-
-INSTRUCTION void instruction_BIT(uint8_t bit_index, uint8_t byte_to_check, int num_cycles) {
-    if (byte_to_check & (0x01 << bit_index)) registers.f &= ~FLAG_Z;
+static void test_bit(uint8_t value, uint8_t bit_mask) {
+    if (value & bit_mask) registers.f &= ~FLAG_Z;
     else registers.f |= FLAG_Z;
     
     registers.f &= ~FLAG_N;
     registers.f |= FLAG_H;
-    
-    robingb_finish_instruction(1, num_cycles);
 }
 
-INSTRUCTION void instruction_RES(uint8_t bit_index, uint8_t *byte_to_reset, uint8_t num_cycles) {
-    *byte_to_reset &= ~(0x01 << bit_index);
-    robingb_finish_instruction(1, num_cycles);
-}
-
-INSTRUCTION void instruction_SET(uint8_t bit_index, uint8_t *register_to_set, uint8_t num_cycles) {
-    *register_to_set |= 0x01 << bit_index;
-    robingb_finish_instruction(1, num_cycles);
-}
-
-void robingb_execute_cb_opcode() {
-    assert(robingb_memory_read(registers.pc) == 0xcb);
-    uint8_t opcode = robingb_memory_read(++registers.pc);
+/* opcode is evaluated several times, so that it can be folded away when it's a constant. */
+#define EXECUTE_CB_OPCODE(opcode) do { \
+    uint8_t operand_index = (opcode) & 0x07; \
+    uint8_t value = (operand_index == HL_OPERAND_INDEX) \
+        ? robingb_memory_read(registers.hl) : *operand_registers[operand_index]; \
+    uint8_t bit_mask = 0x01 << (((opcode) >> 3) & 0x07); \
+    \
+    switch ((opcode) >> 6) { \
+        case 0: value = rotate_or_shift(((opcode) >> 3) & 0x07, value); break; \
+        case 1: test_bit(value, bit_mask); break; \
+        case 2: value &= ~bit_mask; break; /* RES */ \
+        default: value |= bit_mask; break; /* SET */ \
+    } \
+    \
+    if (((opcode) >> 6) != 1) { /* everything except BIT writes the result back */ \
+        if (operand_index == HL_OPERAND_INDEX) robingb_memory_write(registers.hl, value); \
+        else *operand_registers[operand_index] = value; \
+    } \
+    \
+    robingb_finish_instruction(1, operand_index == HL_OPERAND_INDEX ? 16 : 8); \
+} while (0)
+
+#ifdef ROBINGB_UNROLLED_CB_OPCODES
+
+#define CB_CASE(opcode) case (opcode): EXECUTE_CB_OPCODE(opcode); break;
+#define CB_CASES_8(first_opcode) \
+    CB_CASE((first_opcode)+0) CB_CASE((first_opcode)+1) CB_CASE((first_opcode)+2) CB_CASE((first_opcode)+3) \
+    CB_CASE((first_opcode)+4) CB_CASE((first_opcode)+5) CB_CASE((first_opcode)+6) CB_CASE((first_opcode)+7)
+#define CB_CASES_64(first_opcode) \
+    CB_CASES_8((first_opcode)+0x00) CB_CASES_8((first_opcode)+0x08) CB_CASES_8((first_opcode)+0x10) CB_CASES_8((first_opcode)+0x18) \
+    CB_CASES_8((first_opcode)+0x20) CB_CASES_8((first_opcode)+0x28) CB_CASES_8((first_opcode)+0x30) CB_CASES_8((first_opcode)+0x38)
+
+void robingb_execute_cb_opcode(uint8_t opcode) {
+    registers.pc++; /* skip the 0xcb prefix */
     
     switch (opcode) {
-        case 0x00: DEBUG_set_opcode_name("RLC B"); instruction_RLC(&registers.b, 8); break;
-        case 0x01: DEBUG_set_opcode_name("RLC C"); instruction_RLC(&registers.c, 8); break;
-        case 0x02: DEBUG_set_opcode_name("RLC D"); instruction_RLC(&registers.d, 8); break;
-        case 0x03: DEBUG_set_opcode_name("RLC E"); instruction_RLC(&registers.e, 8); break;
-        case 0x04: DEBUG_set_opcode_name("RLC H"); instruction_RLC(&registers.h, 8); break;
-        case 0x05: DEBUG_set_opcode_name("RLC L"); instruction_RLC(&registers.l, 8); break;
-        case 0x06: {
-            uint8_t hl_value = robingb_memory_read(registers.hl);
-            instruction_RLC(&hl_value, 16);
-            robingb_memory_write(registers.hl, hl_value);
-        } break;
-        case 0x07: instruction_RLC(&registers.a, 8); break;
-        case 0x08: instruction_RRC(&registers.b, 8); break;
-        case 0x09: instruction_RRC(&registers.c, 8); break;
-        case 0x0a: instruction_RRC(&registers.d, 8); break;
-        case 0x0b: instruction_RRC(&registers.e, 8); break;
-        case 0x0c: instruction_RRC(&registers.h, 8); break;
-        case 0x0d: instruction_RRC(&registers.l, 8); break;
-        case 0x0e: {
-                    uint8_t hl_value = robingb_memory_read(registers.hl);
-                    instruction_RRC(&hl_value, 16);
-                    robingb_memory_write(registers.hl, hl_value);
-                } break;
-        case 0x0f: instruction_RRC(&registers.a, 8); break;
-        case 0x10: instruction_RL(&registers.b, 8); break;
-        case 0x11: instruction_RL(&registers.c, 8); break;
-        case 0x12: instruction_RL(&registers.d, 8); break;
-        case 0x13: instruction_RL(&registers.e, 8); break;
-        case 0x14: instruction_RL(&registers.h, 8); break;
-        case 0x15: instruction_RL(&registers.l, 8); break;
-        case 0x16: {
-            uint8_t hl_value = robingb_memory_read(registers.hl);
-            instruction_RL(&hl_value, 16);
-            robingb_memory_write(registers.hl, hl_value);
-        } break;
-        case 0x17: instruction_RL(&registers.a, 8); break;
-        case 0x18: instruction_RR(&registers.b, 8); break;
-        case 0x19: instruction_RR(&registers.c, 8); break;
-        case 0x1a: instruction_RR(&registers.d, 8); break;
-        case 0x1b: instruction_RR(&registers.e, 8); break;
-        case 0x1c: instruction_RR(&registers.h, 8); break;
-        case 0x1d: instruction_RR(&registers.l, 8); break;
-        case 0x1e: {
-            uint8_t hl_value = robingb_memory_read(registers.hl);
-            instruction_RR(&hl_value, 16);
-            robingb_memory_write(registers.hl, hl_value);
-        } break;
-        case 0x1f: instruction_RR(&registers.a, 8); break;
-        case 0x20: instruction_SLA(&registers.b); break;
-        case 0x21: instruction_SLA(&registers.c); break;
-        case 0x22: instruction_SLA(&registers.d); break;
-        case 0x23: instruction_SLA(&registers.e); break;
-        case 0x24: instruction_SLA(&registers.h); break;
-        case 0x25: instruction_SLA(&registers.l); break;
-        case 0x26: {
-            uint8_t hl_value = robingb_memory_read(registers.hl);
-            instruction_SLA(&hl_value);
-            robingb_memory_write(registers.hl, hl_value);
-        } break;
-        case 0x27: instruction_SLA(&registers.a); break;
-        case 0x28: instruction_SRA(&registers.b, 8); break;
-        case 0x29: instruction_SRA(&registers.c, 8); break;
-        case 0x2a: instruction_SRA(&registers.d, 8); break;
-        case 0x2b: instruction_SRA(&registers.e, 8); break;
-        case 0x2c: instruction_SRA(&registers.h, 8); break;
-        case 0x2d: instruction_SRA(&registers.l, 8); break;
-        case 0x2e: {
-            uint8_t hl_value = robingb_memory_read(registers.hl);
-            instruction_SRA(&hl_value, 16);
-            robingb_memory_write(registers.hl, hl_value);
-        } break;
-        case 0x2f: instruction_SRA(&registers.a, 8); break;
-        case 0x30: instruction_SWAP(&registers.b, 8); break;
-        case 0x31: instruction_SWAP(&registers.c, 8); break;
-        case 0x32: instruction_SWAP(&registers.d, 8); break;
-        case 0x33: instruction_SWAP(&registers.e, 8); break;
-        case 0x34: instruction_SWAP(&registers.h, 8); break;
-        case 0x35: instruction_SWAP(&registers.l, 8); break;
-        case 0x36: {
-            uint8_t hl_value = robingb_memory_read(registers.hl);
-            instruction_SWAP(&hl_value, 16);
-            robingb_memory_write(registers.hl, hl_value);
-        } break;
-        case 0x37: instruction_SWAP(&registers.a, 8); break;
-        case 0x38: instruction_SRL(&registers.b, 8); break;
-        case 0x39: instruction_SRL(&registers.c, 8); break;
-        case 0x3a: instruction_SRL(&registers.d, 8); break;
-        case 0x3b: instruction_SRL(&registers.e, 8); break;
-        case 0x3c: instruction_SRL(&registers.h, 8); break;
-        case 0x3d: instruction_SRL(&registers.l, 8); break;
-        case 0x3e: {
-            uint8_t hl_value = robingb_memory_read(registers.hl);
-            instruction_SRL(&hl_value, 16);
-            robingb_memory_write(registers.hl, hl_value);
-        } break;
-        case 0x3f: instruction_SRL(&registers.a, 8); break;
-        case 0x40: instruction_BIT(0, registers.b, 8); break;
-        case 0x41: instruction_BIT(0, registers.c, 8); break;
-        case 0x42: instruction_BIT(0, registers.d, 8); break;
-        case 0x43: instruction_BIT(0, registers.e, 8); break;
-        case 0x44: instruction_BIT(0, registers.h, 8); break;
-        case 0x45: instruction_BIT(0, registers.l, 8); break;
-        case 0x46: instruction_BIT(0, robingb_memory_read(registers.hl), 16); break;
-        case 0x47: instruction_BIT(0, registers.a, 8); break;
-        case 0x48: instruction_BIT(1, registers.b, 8); break;
-        case 0x49: instruction_BIT(1, registers.c, 8); break;
-        case 0x4a: instruction_BIT(1, registers.d, 8); break;
-        case 0x4b: instruction_BIT(1, registers.e, 8); break;
-        case 0x4c: instruction_BIT(1, registers.h, 8); break;
-        case 0x4d: instruction_BIT(1, registers.l, 8); break;
-        case 0x4e: instruction_BIT(1, robingb_memory_read(registers.hl), 16); break;
-        case 0x4f: instruction_BIT(1, registers.a, 8); break;
-        case 0x50: instruction_BIT(2, registers.b, 8); break;
-        case 0x51: instruction_BIT(2, registers.c, 8); break;
-        case 0x52: instruction_BIT(2, registers.d, 8); break;
-        case 0x53: instruction_BIT(2, registers.e, 8); break;
-        case 0x54: instruction_BIT(2, registers.h, 8); break;
-        case 0x55: instruction_BIT(2, registers.l, 8); break;
-        case 0x56: instruction_BIT(2, robingb_memory_read(registers.hl), 16); break;
-        case 0x57: instruction_BIT(2, registers.a, 8); break;
-        case 0x58: instruction_BIT(3, registers.b, 8); break;
-        case 0x59: instruction_BIT(3, registers.c, 8); break;
-        case 0x5a: instruction_BIT(3, registers.d, 8); break;
-        case 0x5b: instruction_BIT(3, registers.e, 8); break;
-        case 0x5c: instruction_BIT(3, registers.h, 8); break;
-        case 0x5d: instruction_BIT(3, registers.l, 8); break;
-        case 0x5e: instruction_BIT(3, robingb_memory_read(registers.hl), 16); break;
-        case 0x5f: instruction_BIT(3, registers.a, 8); break;
-        case 0x60: instruction_BIT(4, registers.b, 8); break;
-        case 0x61: instruction_BIT(4, registers.c, 8); break;
-        case 0x62: instruction_BIT(4, registers.d, 8); break;
-        case 0x63: instruction_BIT(4, registers.e, 8); break;
-        case 0x64: instruction_BIT(4, registers.h, 8); break;
-        case 0x65: instruction_BIT(4, registers.l, 8); break;
-        case 0x66: instruction_BIT(4, robingb_memory_read(registers.hl), 16); break;
-        case 0x67: instruction_BIT(4, registers.a, 8); break;
-        case 0x68: instruction_BIT(5, registers.b, 8); break;
-        case 0x69: instruction_BIT(5, registers.c, 8); break;
-        case 0x6a: instruction_BIT(5, registers.d, 8); break;
-        case 0x6b: instruction_BIT(5, registers.e, 8); break;
-        case 0x6c: instruction_BIT(5, registers.h, 8); break;
-        case 0x6d: instruction_BIT(5, registers.l, 8); break;
-        case 0x6e: instruction_BIT(5, robingb_memory_read(registers.hl), 16); break;
-        case 0x6f: instruction_BIT(5, registers.a, 8); break;
-        case 0x70: instruction_BIT(6, registers.b, 8); break;
-        case 0x71: instruction_BIT(6, registers.c, 8); break;
-        case 0x72: instruction_BIT(6, registers.d, 8); break;
-        case 0x73: instruction_BIT(6, registers.e, 8); break;
-        case 0x74: instruction_BIT(6, registers.h, 8); break;
-        case 0x75: instruction_BIT(6, registers.l, 8); break;
-        case 0x76: instruction_BIT(6, robingb_memory_read(registers.hl), 16); break;
-        case 0x77: instruction_BIT(6, registers.a, 8); break;
-        case 0x78: instruction_BIT(7, registers.b, 8); break;
-        case 0x79: instruction_BIT(7, registers.c, 8); break;
-        case 0x7a: instruction_BIT(7, registers.d, 8); break;
-        case 0x7b: instruction_BIT(7, registers.e, 8); break;
-        case 0x7c: instruction_BIT(7, registers.h, 8); break;
-        case 0x7d: instruction_BIT(7, registers.l, 8); break;
-        case 0x7e: instruction_BIT(7, robingb_memory_read(registers.hl), 16); break;
-        case 0x7f: instruction_BIT(7, registers.a, 8); break;
-        case 0x80: instruction_RES(0, &registers.b, 8); break;
-        case 0x81: instruction_RES(0, &registers.c, 8); break;
-        case 0x82: instruction_RES(0, &registers.d, 8); break;
-        case 0x83: instruction_RES(0, &registers.e, 8); break;
-        case 0x84: instruction_RES(0, &registers.h, 8); break;
-        case 0x85: instruction_RES(0, &registers.l, 8); break;
-        case 0x86: {
-            uint8_t hl_value = robingb_memory_read(registers.hl);
-            instruction_RES(0, &hl_value, 16);
-            robingb_memory_write(registers.hl, hl_value);
-        } break;
-        case 0x87: instruction_RES(0, &registers.a, 8); break;
-        case 0x88: instruction_RES(1, &registers.b, 8); break;
-        case 0x89: instruction_RES(1, &registers.c, 8); break;
-        case 0x8a: instruction_RES(1, &registers.d, 8); break;
-        case 0x8b: instruction_RES(1, &registers.e, 8); break;
-        case 0x8c: instruction_RES(1, &registers.h, 8); break;
-        case 0x8d: instruction_RES(1, &registers.l, 8); break;
-        case 0x8e: {
-            uint8_t hl_value = robingb_memory_read(registers.hl);
-            instruction_RES(1, &hl_value, 16);
-            robingb_memory_write(registers.hl, hl_value);
-        } break;
-        case 0x8f: instruction_RES(1, &registers.a, 8); break;
-        case 0x90: instruction_RES(2, &registers.b, 8); break;
-        case 0x91: instruction_RES(2, &registers.c, 8); break;
-        case 0x92: instruction_RES(2, &registers.d, 8); break;
-        case 0x93: instruction_RES(2, &registers.e, 8); break;
-        case 0x94: instruction_RES(2, &registers.h, 8); break;
-        case 0x95: instruction_RES(2, &registers.l, 8); break;
-        case 0x96: {
-            uint8_t hl_value = robingb_memory_read(registers.hl);
-            instruction_RES(2, &hl_value, 16);
-            robingb_memory_write(registers.hl, hl_value);
-        } break;
-        case 0x97: instruction_RES(2, &registers.a, 8); break;
-        case 0x98: instruction_RES(3, &registers.b, 8); break;
-        case 0x99: instruction_RES(3, &registers.c, 8); break;
-        case 0x9a: instruction_RES(3, &registers.d, 8); break;
-        case 0x9b: instruction_RES(3, &registers.e, 8); break;
-        case 0x9c: instruction_RES(3, &registers.h, 8); break;
-        case 0x9d: instruction_RES(3, &registers.l, 8); break;
-        case 0x9e: {
-            uint8_t hl_value = robingb_memory_read(registers.hl);
-            instruction_RES(3, &hl_value, 16);
-            robingb_memory_write(registers.hl, hl_value);
-        } break;
-        case 0x9f: instruction_RES(3, &registers.a, 8); break;
-        case 0xa0: instruction_RES(4, &registers.b, 8); break;
-        case 0xa1: instruction_RES(4, &registers.c, 8); break;
-        case 0xa2: instruction_RES(4, &registers.d, 8); break;
-        case 0xa3: instruction_RES(4, &registers.e, 8); break;
-        case 0xa4: instruction_RES(4, &registers.h, 8); break;
-        case 0xa5: instruction_RES(4, &registers.l, 8); break;
-        case 0xa6: {
-            uint8_t hl_value = robingb_memory_read(registers.hl);
-            instruction_RES(4, &hl_value, 16);
-            robingb_memory_write(registers.hl, hl_value);
-        } break;
-        case 0xa7: instruction_RES(4, &registers.a, 8); break;
-        case 0xa8: instruction_RES(5, &registers.b, 8); break;
-        case 0xa9: instruction_RES(5, &registers.c, 8); break;
-        case 0xaa: instruction_RES(5, &registers.d, 8); break;
-        case 0xab: instruction_RES(5, &registers.e, 8); break;
-        case 0xac: instruction_RES(5, &registers.h, 8); break;
-        case 0xad: instruction_RES(5, &registers.l, 8); break;
-        case 0xae: {
-            uint8_t hl_value = robingb_memory_read(registers.hl);
-            instruction_RES(5, &hl_value, 16);
-            robingb_memory_write(registers.hl, hl_value);
-        } break;
-        case 0xaf: instruction_RES(5, &registers.a, 8); break;
-        case 0xb0: instruction_RES(6, &registers.b, 8); break;
-        case 0xb1: instruction_RES(6, &registers.c, 8); break;
-        case 0xb2: instruction_RES(6, &registers.d, 8); break;
-        case 0xb3: instruction_RES(6, &registers.e, 8); break;
-        case 0xb4: instruction_RES(6, &registers.h, 8); break;
-        case 0xb5: instruction_RES(6, &registers.l, 8); break;
-        case 0xb6: {
-            uint8_t hl_value = robingb_memory_read(registers.hl);
-            instruction_RES(6, &hl_value, 16);
-            robingb_memory_write(registers.hl, hl_value);
-        } break;
-        case 0xb7: instruction_RES(6, &registers.a, 8); break;
-        case 0xb8: instruction_RES(7, &registers.b, 8); break;
-        case 0xb9: instruction_RES(7, &registers.c, 8); break;
-        case 0xba: instruction_RES(7, &registers.d, 8); break;
-        case 0xbb: instruction_RES(7, &registers.e, 8); break;
-        case 0xbc: instruction_RES(7, &registers.h, 8); break;
-        case 0xbd: instruction_RES(7, &registers.l, 8); break;
-        case 0xbe: {
-            uint8_t hl_value = robingb_memory_read(registers.hl);
-            instruction_RES(7, &hl_value, 16);
-            robingb_memory_write(registers.hl, hl_value);
-        } break;
-        case 0xbf: instruction_RES(7, &registers.a, 8); break;
-        case 0xc0: instruction_SET(0, &registers.b, 8); break;
-        case 0xc1: instruction_SET(0, &registers.c, 8); break;
-        case 0xc2: instruction_SET(0, &registers.d, 8); break;
-        case 0xc3: instruction_SET(0, &registers.e, 8); break;
-        case 0xc4: instruction_SET(0, &registers.h, 8); break;
-        case 0xc5: instruction_SET(0, &registers.l, 8); break;
-        case 0xc6: {
-            uint8_t hl_value = robingb_memory_read(registers.hl);
-            instruction_SET(0, &hl_value, 16);
-            robingb_memory_write(registers.hl, hl_value);
-        } break;
-        case 0xc7: instruction_SET(0, &registers.a, 8); break;
-        case 0xc8: instruction_SET(1, &registers.b, 8); break;
-        case 0xc9: instruction_SET(1, &registers.c, 8); break;
-        case 0xca: instruction_SET(1, &registers.d, 8); break;
-        case 0xcb: instruction_SET(1, &registers.e, 8); break;
-        case 0xcc: instruction_SET(1, &registers.h, 8); break;
-        case 0xcd: instruction_SET(1, &registers.l, 8); break;
-        case 0xce: {
-            uint8_t hl_value = robingb_memory_read(registers.hl);
-            instruction_SET(1, &hl_value, 16);
-            robingb_memory_write(registers.hl, hl_value);
-        } break;
-        case 0xcf: instruction_SET(1, &registers.a, 8); break;
-        case 0xd0: instruction_SET(2, &registers.b, 8); break;
-        case 0xd1: instruction_SET(2, &registers.c, 8); break;
-        case 0xd2: instruction_SET(2, &registers.d, 8); break;
-        case 0xd3: instruction_SET(2, &registers.e, 8); break;
-        case 0xd4: instruction_SET(2, &registers.h, 8); break;
-        case 0xd5: instruction_SET(2, &registers.l, 8); break;
-        case 0xd6: {
-            uint8_t hl_value = robingb_memory_read(registers.hl);
-            instruction_SET(2, &hl_value, 16);
-            robingb_memory_write(registers.hl, hl_value);
-        } break;
-        case 0xd7: instruction_SET(2, &registers.a, 8); break;
-        case 0xd8: instruction_SET(3, &registers.b, 8); break;
-        case 0xd9: instruction_SET(3, &registers.c, 8); break;
-        case 0xda: instruction_SET(3, &registers.d, 8); break;
-        case 0xdb: instruction_SET(3, &registers.e, 8); break;
-        case 0xdc: instruction_SET(3, &registers.h, 8); break;
-        case 0xdd: instruction_SET(3, &registers.l, 8); break;
-        case 0xde: {
-            uint8_t hl_value = robingb_memory_read(registers.hl);
-            instruction_SET(3, &hl_value, 16);
-            robingb_memory_write(registers.hl, hl_value);
-        } break;
-        case 0xdf: instruction_SET(3, &registers.a, 8); break;
-        case 0xe0: instruction_SET(4, &registers.b, 8); break;
-        case 0xe1: instruction_SET(4, &registers.c, 8); break;
-        case 0xe2: instruction_SET(4, &registers.d, 8); break;
-        case 0xe3: instruction_SET(4, &registers.e, 8); break;
-        case 0xe4: instruction_SET(4, &registers.h, 8); break;
-        case 0xe5: instruction_SET(4, &registers.l, 8); break;
-        case 0xe6: {
-            uint8_t hl_value = robingb_memory_read(registers.hl);
-            instruction_SET(4, &hl_value, 16);
-            robingb_memory_write(registers.hl, hl_value);
-        } break;
-        case 0xe7: instruction_SET(4, &registers.a, 8); break;
-        case 0xe8: instruction_SET(5, &registers.b, 8); break;
-        case 0xe9: instruction_SET(5, &registers.c, 8); break;
-        case 0xea: instruction_SET(5, &registers.d, 8); break;
-        case 0xeb: instruction_SET(5, &registers.e, 8); break;
-        case 0xec: instruction_SET(5, &registers.h, 8); break;
-        case 0xed: instruction_SET(5, &registers.l, 8); break;
-        case 0xee: {
-            uint8_t hl_value = robingb_memory_read(registers.hl);
-            instruction_SET(5, &hl_value, 16);
-            robingb_memory_write(registers.hl, hl_value);
-        } break;
-        case 0xef: instruction_SET(5, &registers.a, 8); break;
-        case 0xf0: instruction_SET(6, &registers.b, 8); break;
-        case 0xf1: instruction_SET(6, &registers.c, 8); break;
-        case 0xf2: instruction_SET(6, &registers.d, 8); break;
-        case 0xf3: instruction_SET(6, &registers.e, 8); break;
-        case 0xf4: instruction_SET(6, &registers.h, 8); break;
-        case 0xf5: instruction_SET(6, &registers.l, 8); break;
-        case 0xf6: {
-            uint8_t hl_value = robingb_memory_read(registers.hl);
-            instruction_SET(6, &hl_value, 16);
-            robingb_memory_write(registers.hl, hl_value);
-        } break;
-        case 0xf7: instruction_SET(6, &registers.a, 8); break;
-        case 0xf8: instruction_SET(7, &registers.b, 8); break;
-        case 0xf9: instruction_SET(7, &registers.c, 8); break;
-        case 0xfa: instruction_SET(7, &registers.d, 8); break;
-        case 0xfb: instruction_SET(7, &registers.e, 8); break;
-        case 0xfc: instruction_SET(7, &registers.h, 8); break;
-        case 0xfd: instruction_SET(7, &registers.l, 8); break;
-        case 0xfe: {
-            uint8_t hl_value = robingb_memory_read(registers.hl);
-            instruction_SET(7, &hl_value, 16);
-            robingb_memory_write(registers.hl, hl_value);
-        } break;
-        case 0xff: instruction_SET(7, &registers.a, 8); break;
-        default: {
-            printf("Unknown opcode cb %x at address %x\n", opcode, registers.pc-1);
-            assert(false);
-        } break;
+        CB_CASES_64(0x00)
+        CB_CASES_64(0x40)
+        CB_CASES_64(0x80)
+        CB_CASES_64(0xc0)
     }
 }
 
+#else
 
+void robingb_execute_cb_opcode(uint8_t opcode) {
+    registers.pc++; /* skip the 0xcb prefix */
+    EXECUTE_CB_OPCODE(opcode);
+}
 
-
-
+#endif
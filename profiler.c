@@ -0,0 +1,294 @@
+#include "internal.h"
+#include <stdio.h>
+#include <string.h>
+
+/*
+The profiler samples the instruction being executed every few hundred cycles, and charges
+it with all the cycles since the previous sample, so the cycles add up to exactly what was
+executed. Each sample goes into a small open-addressed hash table keyed on the instruction's
+address. Addresses in the switchable ROM bank are told apart by bank number. Samples that
+don't find a slot within a few probes are only counted by opcode.
+
+Counting every instruction in the dispatcher cost 15-25%, as the hook kept the opcode cases
+from ending in tail calls. Sampling only costs the core one comparison with the cycle count
+per instruction. The interval is jittered, so that loops whose length divides it don't always
+get sampled at the same instruction. It's all left out unless ROBINGB_ENABLE_PROFILER is
+defined in robingb_config.h.
+*/
+
+#ifdef ROBINGB_ENABLE_PROFILER
+
+#define OPCODE_PROFILE_COUNT 512 /* 0x00 to 0xff, then the CB-prefixed opcodes */
+#define ADDRESS_SLOT_COUNT 1024 /* must be a power of 2 */
+#define MAX_ADDRESS_PROBES 8
+#define MIN_SAMPLE_INTERVAL 192 /* in cycles, plus 0 to SAMPLE_INTERVAL_JITTER */
+#define SAMPLE_INTERVAL_JITTER 127 /* must be a power of 2, minus 1 */
+
+typedef struct {
+    uint32_t key; /* (bank << 16 | address) + 1, or 0 for an empty slot */
+    uint16_t opcode; /* part of the key too, because code in RAM can change */
+    uint32_t samples;
+    uint32_t cycles;
+} Address_Slot;
+
+static struct {
+    Address_Slot address_slots[ADDRESS_SLOT_COUNT];
+    uint32_t untracked_samples[OPCODE_PROFILE_COUNT];
+    uint32_t untracked_cycles[OPCODE_PROFILE_COUNT];
+    uint32_t previous_sample_cycle;
+    uint32_t random_state;
+} profile;
+
+uint32_t robingb_next_profile_sample_cycle;
+
+static void start_sample_interval() {
+    /* xorshift32 */
+    profile.random_state ^= profile.random_state << 13;
+    profile.random_state ^= profile.random_state >> 17;
+    profile.random_state ^= profile.random_state << 5;
+    
+    profile.previous_sample_cycle = robingb_cycle_count;
+    robingb_next_profile_sample_cycle = robingb_cycle_count + MIN_SAMPLE_INTERVAL + (profile.random_state & SAMPLE_INTERVAL_JITTER);
+}
+
+void robingb_reset_profile() {
+    memset(&profile, 0, sizeof(profile));
+    profile.random_state = 0x2545f491;
+    start_sample_interval();
+}
+
+void robingb_exclude_from_profile(uint32_t num_cycles) {
+    profile.previous_sample_cycle += num_cycles;
+    robingb_next_profile_sample_cycle += num_cycles;
+}
+
+void robingb_take_profile_sample(uint16_t address) {
+    uint32_t num_cycles = robingb_cycle_count - profile.previous_sample_cycle;
+    uint16_t opcode = robingb_memory_read(address);
+    uint16_t bank = (address >= 0x4000 && address < 0x8000) ? robingb_romb_get_switchable_bank_number() : 0;
+    uint32_t key = ((uint32_t)bank << 16 | address) + 1;
+    uint16_t slot_index = (address ^ (bank << 7)) & (ADDRESS_SLOT_COUNT-1);
+    uint8_t probe;
+    
+    if (opcode == 0xcb) opcode = 0x100 + robingb_memory_read(address+1);
+    
+    start_sample_interval();
+    
+    for (probe = 0; probe < MAX_ADDRESS_PROBES; probe++) {
+        Address_Slot *slot = &profile.address_slots[(slot_index + probe) & (ADDRESS_SLOT_COUNT-1)];
+        
+        if (slot->key == 0) {
+            slot->key = key;
+            slot->opcode = opcode;
+        }
+        
+        if (slot->key == key && slot->opcode == opcode) {
+            slot->samples++;
+            slot->cycles += num_cycles;
+            return;
+        }
+    }
+    
+    profile.untracked_samples[opcode]++;
+    profile.untracked_cycles[opcode] += num_cycles;
+}
+
+/* The opcode totals aren't counted as the game runs, to keep the profiler cheap. They're
+added up from the address table when they're needed, and the address cycles are copied into
+an array of their own for find_next_costliest(). */
+static uint32_t opcode_samples[OPCODE_PROFILE_COUNT];
+static uint32_t opcode_cycles[OPCODE_PROFILE_COUNT];
+static uint32_t address_cycles[ADDRESS_SLOT_COUNT];
+
+static void gather_totals() {
+    uint16_t i;
+    
+    memcpy(opcode_samples, profile.untracked_samples, sizeof(opcode_samples));
+    memcpy(opcode_cycles, profile.untracked_cycles, sizeof(opcode_cycles));
+    
+    for (i = 0; i < ADDRESS_SLOT_COUNT; i++) {
+        Address_Slot *slot = &profile.address_slots[i];
+        opcode_samples[slot->opcode] += slot->samples;
+        opcode_cycles[slot->opcode] += slot->cycles;
+        address_cycles[i] = slot->cycles;
+    }
+}
+
+/* Finds the entry with the most cycles that comes after previous_index in the order of most
+cycles first (ties broken by index). Returns -1 if there are no more entries with cycles. */
+static int32_t find_next_costliest(const uint32_t cycles[], uint32_t entry_count, int32_t previous_index) {
+    uint32_t previous_cycles = previous_index >= 0 ? cycles[previous_index] : 0xffffffff;
+    int32_t best_index = -1;
+    uint32_t best_cycles = 0;
+    uint32_t i;
+    
+    for (i = 0; i < entry_count; i++) {
+        uint32_t entry_cycles = cycles[i];
+        
+        if (entry_cycles == 0) continue;
+        if (entry_cycles > previous_cycles) continue;
+        if (entry_cycles == previous_cycles && (int32_t)i <= previous_index) continue;
+        
+        if (entry_cycles > best_cycles) {
+            best_cycles = entry_cycles;
+            best_index = i;
+        }
+    }
+    
+    return best_index;
+}
+
+/* These fill in the entry that comes after previous_index, returning its index, or -1 if
+there are no more. */
+static int32_t get_next_opcode_profile(int32_t previous_index, RobinGB_Opcode_Profile *profile_out) {
+    int32_t index = find_next_costliest(opcode_cycles, OPCODE_PROFILE_COUNT, previous_index);
+    
+    if (index >= 0) {
+        profile_out->opcode = index;
+        profile_out->samples = opcode_samples[index];
+        profile_out->cycles = opcode_cycles[index];
+    }
+    
+    return index;
+}
+
+static int32_t get_next_address_profile(int32_t previous_index, RobinGB_Address_Profile *profile_out) {
+    int32_t index = find_next_costliest(address_cycles, ADDRESS_SLOT_COUNT, previous_index);
+    
+    if (index >= 0) {
+        Address_Slot *slot = &profile.address_slots[index];
+        profile_out->bank = (slot->key - 1) >> 16;
+        profile_out->address = (slot->key - 1) & 0xffff;
+        profile_out->opcode = slot->opcode;
+        profile_out->samples = slot->samples;
+        profile_out->cycles = slot->cycles;
+    }
+    
+    return index;
+}
+
+uint16_t robingb_get_opcode_profile(RobinGB_Opcode_Profile profiles_out[], uint16_t max_count) {
+    uint16_t count = 0;
+    int32_t index = -1;
+    
+    gather_totals();
+    while (count < max_count && (index = get_next_opcode_profile(index, &profiles_out[count])) >= 0) count++;
+    return count;
+}
+
+uint16_t robingb_get_address_profile(RobinGB_Address_Profile profiles_out[], uint16_t max_count) {
+    uint16_t count = 0;
+    int32_t index = -1;
+    
+    gather_totals();
+    while (count < max_count && (index = get_next_address_profile(index, &profiles_out[count])) >= 0) count++;
+    return count;
+}
+
+/* Appends text to the file, returning false if it couldn't be written or didn't fit in the
+line buffer. */
+static bool write_line(const char *path, const char *line, int line_length, size_t buffer_size) {
+    if (line_length < 0 || (size_t)line_length >= buffer_size) return false;
+    return robingb_write_file(path, true, line_length, (uint8_t*)line);
+}
+
+bool robingb_write_profile(const char *path, bool json, uint16_t max_count) {
+    char line[160];
+    int line_length;
+    RobinGB_Opcode_Profile opcode_profile;
+    RobinGB_Address_Profile address_profile;
+    uint32_t total_cycles = 0, untracked_samples = 0, untracked_cycles = 0;
+    uint16_t i;
+    int32_t index;
+    
+    gather_totals();
+    
+    for (i = 0; i < OPCODE_PROFILE_COUNT; i++) {
+        total_cycles += opcode_cycles[i];
+        untracked_samples += profile.untracked_samples[i];
+        untracked_cycles += profile.untracked_cycles[i];
+    }
+    
+    /* start with an empty file */
+    if (!robingb_write_file(path, false, 0, (uint8_t*)line)) return false;
+    
+    if (json) line_length = snprintf(line, sizeof(line), "{\n\"total_cycles\": %lu,\n\"opcodes\": [\n", (unsigned long)total_cycles);
+    else line_length = snprintf(line, sizeof(line), "%lu cycles profiled\n\nopcode    samples     cycles\n", (unsigned long)total_cycles);
+    if (!write_line(path, line, line_length, sizeof(line))) return false;
+    
+    /* The entries are fetched one at a time, so that no buffer is needed. */
+    index = -1;
+    for (i = 0; i < max_count; i++) {
+        index = get_next_opcode_profile(index, &opcode_profile);
+        if (index < 0) break;
+        
+        if (json) {
+            line_length = snprintf(line, sizeof(line), "%s{\"opcode\": \"%s%02x\", \"samples\": %lu, \"cycles\": %lu}", i ? ",\n" : "",
+                opcode_profile.opcode >= 0x100 ? "cb" : "", opcode_profile.opcode & 0xff,
+                (unsigned long)opcode_profile.samples, (unsigned long)opcode_profile.cycles);
+        } else {
+            line_length = snprintf(line, sizeof(line), "%s%02x    %10lu %10lu\n", opcode_profile.opcode >= 0x100 ? "cb" : "  ", opcode_profile.opcode & 0xff,
+                (unsigned long)opcode_profile.samples, (unsigned long)opcode_profile.cycles);
+        }
+        
+        if (!write_line(path, line, line_length, sizeof(line))) return false;
+    }
+    
+    if (json) line_length = snprintf(line, sizeof(line), "\n],\n\"addresses\": [\n");
+    else line_length = snprintf(line, sizeof(line), "\nbank:address  opcode    samples     cycles\n");
+    if (!write_line(path, line, line_length, sizeof(line))) return false;
+    
+    index = -1;
+    for (i = 0; i < max_count; i++) {
+        index = get_next_address_profile(index, &address_profile);
+        if (index < 0) break;
+        
+        if (json) {
+            line_length = snprintf(line, sizeof(line), "%s{\"bank\": %u, \"address\": \"%04x\", \"opcode\": \"%s%02x\", \"samples\": %lu, \"cycles\": %lu}",
+                i ? ",\n" : "", address_profile.bank, address_profile.address,
+                address_profile.opcode >= 0x100 ? "cb" : "", address_profile.opcode & 0xff,
+                (unsigned long)address_profile.samples, (unsigned long)address_profile.cycles);
+        } else {
+            line_length = snprintf(line, sizeof(line), "%4x:%04x   %s%02x    %10lu %10lu\n", address_profile.bank, address_profile.address,
+                address_profile.opcode >= 0x100 ? "cb" : "  ", address_profile.opcode & 0xff,
+                (unsigned long)address_profile.samples, (unsigned long)address_profile.cycles);
+        }
+        
+        if (!write_line(path, line, line_length, sizeof(line))) return false;
+    }
+    
+    if (json) {
+        line_length = snprintf(line, sizeof(line), "\n],\n\"untracked_samples\": %lu,\n\"untracked_cycles\": %lu\n}\n",
+            (unsigned long)untracked_samples, (unsigned long)untracked_cycles);
+    } else {
+        line_length = snprintf(line, sizeof(line), "\n%lu samples (%lu cycles) at addresses that didn't fit in the table\n",
+            (unsigned long)untracked_samples, (unsigned long)untracked_cycles);
+    }
+    
+    return write_line(path, line, line_length, sizeof(line));
+}
+
+#else /* ROBINGB_ENABLE_PROFILER */
+
+void robingb_reset_profile() {}
+
+uint16_t robingb_get_opcode_profile(RobinGB_Opcode_Profile profiles_out[], uint16_t max_count) {
+    (void)profiles_out;
+    (void)max_count;
+    return 0;
+}
+
+uint16_t robingb_get_address_profile(RobinGB_Address_Profile profiles_out[], uint16_t max_count) {
+    (void)profiles_out;
+    (void)max_count;
+    return 0;
+}
+
+bool robingb_write_profile(const char *path, bool json, uint16_t max_count) {
+    (void)path;
+    (void)json;
+    (void)max_count;
+    return false;
+}
+
+#endif /* ROBINGB_ENABLE_PROFILER */
@@ -1,6 +1,7 @@
 #include "internal.h"
 #include <assert.h>
 #include <string.h>
+#include <stdlib.h>
 
 #define LCDC_WINDOW_TILE_MAP_SELECT (0x01 << 6)
 #define LCDC_WINDOW_ENABLED (0x01 << 5)
@@ -22,18 +23,41 @@
 #define TILE_HEIGHT 8
 
 bool robingb_native_pixel_format = false;
+bool robingb_skip_unchanged_lines = false;
 
-static uint8_t *lcdc = &robingb_memory[LCD_CONTROL_ADDRESS];
-static uint8_t *ly = &robingb_memory[LCD_LY_ADDRESS];
-static uint8_t *bg_palette = &robingb_memory[0xff47];
-static uint8_t *object_palette_0 = &robingb_memory[0xff48];
-static uint8_t *object_palette_1 = &robingb_memory[0xff49];
+#define VRAM_ADDRESS 0x8000
+#define VRAM_SIZE 0x2000
 
-static uint8_t *bg_scroll_y = &robingb_memory[0xff42];
-static uint8_t *bg_scroll_x = &robingb_memory[0xff43];
+/* The registers that a line is rendered from. These are captured from robingb_memory at the
+start of each line, so that lines can also be rendered later on another thread (see the
+render queue at the bottom of this file). */
+typedef struct {
+    uint8_t *screen;
+    uint32_t oam_version; /* see robingb_invalidate_object_index() */
+    uint8_t ly;
+    uint8_t lcdc;
+    uint8_t bg_palette;
+    uint8_t object_palette_0;
+    uint8_t object_palette_1;
+    uint8_t bg_scroll_y;
+    uint8_t bg_scroll_x;
+    uint8_t window_offset_y;
+    uint8_t window_offset_x_plus_7;
+} Line_State;
 
-static uint8_t *window_offset_y = &robingb_memory[0xff4a];
-static uint8_t *window_offset_x_plus_7 = &robingb_memory[0xff4b];
+static Line_State line_state;
+
+static uint8_t *lcdc = &line_state.lcdc;
+static uint8_t *ly = &line_state.ly;
+static uint8_t *bg_palette = &line_state.bg_palette;
+static uint8_t *object_palette_0 = &line_state.object_palette_0;
+static uint8_t *object_palette_1 = &line_state.object_palette_1;
+
+static uint8_t *bg_scroll_y = &line_state.bg_scroll_y;
+static uint8_t *bg_scroll_x = &line_state.bg_scroll_x;
+
+static uint8_t *window_offset_y = &line_state.window_offset_y;
+static uint8_t *window_offset_x_plus_7 = &line_state.window_offset_x_plus_7;
 
 #define SHADE_0_FLAG 0x04
 
@@ -44,6 +68,45 @@ static uint8_t shade_3;
 
 uint8_t *robingb_screen;
 
+/* Where the renderer reads VRAM from: robingb_memory, or the render queue's snapshot of it. */
+static const uint8_t *vram = &robingb_memory[VRAM_ADDRESS];
+
+/* The background, window and objects are drawn into line_buffer as 2-bit shades, plus
+SHADE_0_FLAG. The final step of the render converts the line into the screen buffer through
+a lookup table for the selected pixel format. The tables have 8 entries so that they can
+be indexed without discarding SHADE_0_FLAG first. */
+static uint8_t line_buffer[SCREEN_WIDTH];
+
+#ifdef ROBINGB_FIXED_PIXEL_FORMAT
+#define pixel_format ((RobinGB_Pixel_Format)(ROBINGB_FIXED_PIXEL_FORMAT))
+#else
+static RobinGB_Pixel_Format pixel_format = ROBINGB_PIXEL_FORMAT_8BIT;
+#endif
+
+static const uint8_t grey_lut[8] = { 0xff, 0xaa, 0x55, 0x00, 0xff, 0xaa, 0x55, 0x00 };
+static const uint8_t native_lut[8] = { 0, 1, 2, 3, 0, 1, 2, 3 };
+static uint16_t rgb565_lut[8];
+static uint32_t xrgb8888_lut[8];
+
+/* bytes per screen line for each RobinGB_Pixel_Format */
+static const uint16_t line_sizes[] = { SCREEN_WIDTH, SCREEN_WIDTH*2, SCREEN_WIDTH*4, SCREEN_WIDTH/4 };
+
+/* If line_ready is set, finished lines go to the host one at a time instead of into the screen buffer. */
+static struct {
+    uint8_t *buffer;
+    uint8_t *(*line_ready)(uint8_t screen_line, uint8_t line[]);
+} line_sink;
+
+void robingb_set_line_sink(uint8_t first_line_buffer[], uint8_t *(*line_ready)(uint8_t screen_line, uint8_t line[])) {
+    assert(first_line_buffer || !line_ready);
+    line_sink.buffer = first_line_buffer;
+    line_sink.line_ready = line_ready;
+}
+
+bool robingb_line_sink_is_set() {
+    return line_sink.line_ready != NULL;
+}
+
 static void set_palette(uint8_t palette) {
     /* SHADE_0_FLAG ensures shade_0 is unique, which streamlines the process of shade-0-dependent
     blitting. The flag is discarded in the final step of the render. */
@@ -56,7 +119,8 @@ static void set_palette(uint8_t palette) {
 static void get_tile_line(uint16_t tile_bank_address, int16_t tile_index, uint8_t tile_line_index, uint8_t line_out[]) {
     
     uint16_t tile_address = tile_bank_address + tile_index*NUM_BYTES_PER_TILE;
-    uint16_t line_data = *(uint16_t*)&robingb_memory[tile_address + tile_line_index*NUM_BYTES_PER_TILE_LINE];
+    const uint8_t *line_bytes = &vram[tile_address + tile_line_index*NUM_BYTES_PER_TILE_LINE - VRAM_ADDRESS];
+    uint16_t line_data = line_bytes[0] | (line_bytes[1] << 8);
     
     switch (line_data) {
         case 0x0000: memset(line_out, shade_0, TILE_WIDTH); return; break;
@@ -124,7 +188,7 @@ static void get_tile_line(uint16_t tile_bank_address, int16_t tile_index, uint8_
 
 static void get_bg_tile_line(uint8_t coord_x, uint8_t coord_y, uint16_t tile_map_address_space, uint16_t tile_data_bank_address, uint8_t tile_line_index, uint8_t line_out[]) {
     uint16_t tile_map_index = coord_x + coord_y*NUM_TILES_PER_BG_LINE;
-    int16_t tile_data_index = robingb_memory[tile_map_address_space + tile_map_index];
+    int16_t tile_data_index = vram[tile_map_address_space + tile_map_index - VRAM_ADDRESS];
     
     if (tile_data_bank_address == 0x9000) { /* bank 0x9000 uses signed addressing */
         get_tile_line(tile_data_bank_address, (int8_t)tile_data_index, tile_line_index, line_out);
@@ -142,7 +206,7 @@ static void render_background_line() {
     uint16_t tile_map_address_space = ((*lcdc) & LCDC_BG_TILE_MAP_SELECT) ? 0x9c00 : 0x9800;
     uint16_t tile_data_address_space = ((*lcdc) & LCDC_BG_AND_WINDOW_TILE_DATA_SELECT) ? 0x8000 : 0x9000;
     
-    uint8_t *screen_line = &robingb_screen[(*ly) * SCREEN_WIDTH];
+    uint8_t *screen_line = line_buffer;
     
     int8_t tilegrid_x;
     for (tilegrid_x = 0; tilegrid_x < NUM_TILES_PER_BG_LINE; tilegrid_x++) {
@@ -190,7 +254,13 @@ static void render_window_line() {
     int16_t num_pixels_to_render = SCREEN_WIDTH - window_offset_x;
     int8_t num_tiles_to_render = num_pixels_to_render / TILE_WIDTH;
     
-    uint8_t *screen_with_offset = &robingb_screen[window_offset_x + (*ly)*SCREEN_WIDTH];
+    uint8_t *screen_line = line_buffer;
+    uint8_t *screen_with_offset = &screen_line[window_offset_x];
+    
+    /* If WX < 7, the window starts off the left edge of the screen. Render it into a temporary
+    line instead, so that the end of the previous screen line isn't overwritten. */
+    uint8_t offscreen_line[SCREEN_WIDTH + TILE_WIDTH];
+    if (window_offset_x < 0) screen_with_offset = offscreen_line;
     
     uint8_t tilegrid_x;
     for (tilegrid_x = 0; tilegrid_x < num_tiles_to_render; tilegrid_x++) {
@@ -209,86 +279,354 @@ static void render_window_line() {
             screen_with_offset[screen_x] = tile_pixels[screen_x - num_pixels_rendered];
         }
     }
+    
+    if (window_offset_x < 0) memcpy(screen_line, &offscreen_line[-window_offset_x], SCREEN_WIDTH);
 }
 
-static void render_objects() {
-    uint8_t object_height = 8;
-    if ((*lcdc) & LCDC_DOUBLE_HEIGHT_OBJECTS) object_height = 16;
+/* Optional background cache: a pre-rendered 256x256 bitmap of each tile map (0x9800 and
+0x9c00), holding colour indices before the palette is applied. Tile map and tile data writes
+mark the affected 8x8 cells as dirty, and dirty cells are redrawn just before a line that
+shows them is rendered. The background and window lines are then copied straight out of the
+bitmaps. */
+#define NUM_TILE_MAPS 2
+#define NUM_CELLS_PER_TILE_MAP (NUM_TILES_PER_BG_LINE*NUM_TILES_PER_BG_LINE)
+#define NUM_TILE_DATA_SLOTS 384 /* 0x8000 to 0x97ff */
+
+typedef struct {
+    uint8_t pixels[BG_WIDTH][BG_WIDTH];
+} Bg_Bitmap;
+
+typedef struct {
+    uint8_t dirty_cells[NUM_TILE_MAPS][NUM_CELLS_PER_TILE_MAP/8];
+    uint8_t dirty_tiles[NUM_TILE_DATA_SLOTS/8];
+    bool any_cell_is_dirty;
+    bool any_tile_is_dirty;
+} Vram_Changes;
+
+/* Only used by whichever thread renders. */
+static struct {
+    Bg_Bitmap *bitmaps; /* NULL while the cache is disabled */
+    uint16_t tile_data_address_space; /* that the bitmaps were drawn with */
+    Vram_Changes dirty;
+} bg_cache;
+
+/* VRAM writes are collected here by the emulation thread, and handed to the renderer with
+the next line (or the render queue's next snapshot). */
+static Vram_Changes pending_vram_changes;
+static bool vram_changes_are_tracked = false;
+
+/* Set when VRAM or OAM has been written since the render queue's latest snapshot. */
+static bool snapshot_is_outdated = true;
+
+bool robingb_set_background_cache(bool enabled) {
+    if (enabled && !bg_cache.bitmaps) {
+        bg_cache.bitmaps = (Bg_Bitmap*)malloc(sizeof(Bg_Bitmap) * NUM_TILE_MAPS);
+        if (!bg_cache.bitmaps) return false;
+        
+        memset(&bg_cache.dirty, 0x00, sizeof(bg_cache.dirty));
+        memset(bg_cache.dirty.dirty_cells, 0xff, sizeof(bg_cache.dirty.dirty_cells));
+    } else if (!enabled && bg_cache.bitmaps) {
+        free(bg_cache.bitmaps);
+        bg_cache.bitmaps = NULL;
+    }
+    
+    memset(&pending_vram_changes, 0x00, sizeof(pending_vram_changes));
+    vram_changes_are_tracked = enabled;
+    return true;
+}
+
+void robingb_respond_to_vram_write(uint16_t address) {
+    snapshot_is_outdated = true;
+    
+    if (!vram_changes_are_tracked) return;
+    
+    if (address < 0x9800) {
+        uint16_t tile_slot = (address - 0x8000) / NUM_BYTES_PER_TILE;
+        pending_vram_changes.dirty_tiles[tile_slot/8] |= robingb_bit(tile_slot%8);
+        pending_vram_changes.any_tile_is_dirty = true;
+    } else {
+        uint16_t cell = (address - 0x9800) % NUM_CELLS_PER_TILE_MAP;
+        pending_vram_changes.dirty_cells[(address - 0x9800) / NUM_CELLS_PER_TILE_MAP][cell/8] |= robingb_bit(cell%8);
+        pending_vram_changes.any_cell_is_dirty = true;
+    }
+}
+
+/* Adds VRAM changes to the background cache's dirty cells and tiles, on the render thread. */
+static void apply_vram_changes(const Vram_Changes *changes) {
+    uint16_t i;
     
-    uint8_t *screen_line = &robingb_screen[(*ly) * SCREEN_WIDTH];
+    if (changes->any_cell_is_dirty) {
+        uint8_t *dirty_cells = &bg_cache.dirty.dirty_cells[0][0];
+        const uint8_t *changed_cells = &changes->dirty_cells[0][0];
+        for (i = 0; i < sizeof(bg_cache.dirty.dirty_cells); i++) dirty_cells[i] |= changed_cells[i];
+    }
     
-    uint16_t object_address;
-    for (object_address = 0xfe9c; object_address >= 0xfe00; object_address -= 4) {
-        int16_t translate_y = robingb_memory[object_address] - TILE_HEIGHT*2;
+    if (changes->any_tile_is_dirty) {
+        for (i = 0; i < sizeof(bg_cache.dirty.dirty_tiles); i++) bg_cache.dirty.dirty_tiles[i] |= changes->dirty_tiles[i];
+        bg_cache.dirty.any_tile_is_dirty = true;
+    }
+}
+
+static uint16_t get_tile_data_slot(uint8_t tile_data_index, uint16_t tile_data_address_space) {
+    if (tile_data_address_space == 0x9000) return 256 + (int8_t)tile_data_index;
+    else return tile_data_index;
+}
+
+/* Turns dirty tiles into dirty cells, for every cell that shows one of them. */
+static void mark_cells_with_dirty_tiles() {
+    uint8_t map;
+    for (map = 0; map < NUM_TILE_MAPS; map++) {
+        const uint8_t *tile_map = &vram[0x9800 + map*NUM_CELLS_PER_TILE_MAP - VRAM_ADDRESS];
         
-        if (*ly >= translate_y && *ly < translate_y+object_height) {
-            int16_t translate_x = robingb_memory[object_address+1] - TILE_WIDTH;
-            
-            uint8_t tile_data_index = robingb_memory[object_address+2];
-            
-            /* ignore the lowest bit of the index if in double-height mode */
-            if (object_height > 8) tile_data_index &= 0xfe;
+        uint16_t cell;
+        for (cell = 0; cell < NUM_CELLS_PER_TILE_MAP; cell++) {
+            uint16_t tile_slot = get_tile_data_slot(tile_map[cell], bg_cache.tile_data_address_space);
             
-            uint8_t object_flags = robingb_memory[object_address+3];
-            bool choose_palette_1 = object_flags & robingb_bit(4);
-            bool flip_x = object_flags & robingb_bit(5);
-            bool flip_y = object_flags & robingb_bit(6);
-            bool behind_background = object_flags & robingb_bit(7);
+            if (bg_cache.dirty.dirty_tiles[tile_slot/8] & robingb_bit(tile_slot%8)) {
+                bg_cache.dirty.dirty_cells[map][cell/8] |= robingb_bit(cell%8);
+            }
+        }
+    }
+    
+    memset(bg_cache.dirty.dirty_tiles, 0x00, sizeof(bg_cache.dirty.dirty_tiles));
+    bg_cache.dirty.any_tile_is_dirty = false;
+}
+
+/* Redraws the dirty cells in one row of a tile map and returns the bitmap. */
+static Bg_Bitmap *update_bg_bitmap_row(uint16_t tile_map_address_space, uint8_t tilegrid_y) {
+    uint16_t tile_data_address_space = ((*lcdc) & LCDC_BG_AND_WINDOW_TILE_DATA_SELECT) ? 0x8000 : 0x9000;
+    uint8_t map = (tile_map_address_space == 0x9c00) ? 1 : 0;
+    Bg_Bitmap *bitmap = &bg_cache.bitmaps[map];
+    uint8_t *dirty_cells = &bg_cache.dirty.dirty_cells[map][tilegrid_y*NUM_TILES_PER_BG_LINE/8];
+    uint8_t tilegrid_x;
+    
+    if (tile_data_address_space != bg_cache.tile_data_address_space) {
+        bg_cache.tile_data_address_space = tile_data_address_space;
+        memset(bg_cache.dirty.dirty_cells, 0xff, sizeof(bg_cache.dirty.dirty_cells));
+    }
+    
+    if (bg_cache.dirty.any_tile_is_dirty) mark_cells_with_dirty_tiles();
+    
+    /* a 0xe4 palette maps each colour to itself, so the bitmap holds colour indices */
+    set_palette(0xe4);
+    
+    for (tilegrid_x = 0; tilegrid_x < NUM_TILES_PER_BG_LINE; tilegrid_x++) {
+        uint8_t tile_line_index;
+        if ((dirty_cells[tilegrid_x/8] & robingb_bit(tilegrid_x%8)) == 0) continue;
+        
+        for (tile_line_index = 0; tile_line_index < TILE_HEIGHT; tile_line_index++) {
+            uint8_t *bitmap_line = bitmap->pixels[tilegrid_y*TILE_HEIGHT + tile_line_index];
+            get_bg_tile_line(tilegrid_x, tilegrid_y, tile_map_address_space, tile_data_address_space, tile_line_index, &bitmap_line[tilegrid_x*TILE_WIDTH]);
+        }
+        
+        dirty_cells[tilegrid_x/8] &= ~robingb_bit(tilegrid_x%8);
+    }
+    
+    return bitmap;
+}
+
+static void render_cached_background_and_window_line() {
+    int16_t window_line = (*ly) - (*window_offset_y);
+    int16_t window_offset_x = (*window_offset_x_plus_7) - 7;
+    
+    /* background: at most two copies, as the bitmap wraps around horizontally */
+    {
+        uint8_t bg_y = *ly + *bg_scroll_y;
+        uint16_t tile_map_address_space = ((*lcdc) & LCDC_BG_TILE_MAP_SELECT) ? 0x9c00 : 0x9800;
+        uint8_t *bitmap_line = update_bg_bitmap_row(tile_map_address_space, bg_y / TILE_HEIGHT)->pixels[bg_y];
+        
+        uint16_t num_pixels_before_wrap = BG_WIDTH - (*bg_scroll_x);
+        
+        if (num_pixels_before_wrap >= SCREEN_WIDTH) {
+            memcpy(line_buffer, &bitmap_line[*bg_scroll_x], SCREEN_WIDTH);
+        } else {
+            memcpy(line_buffer, &bitmap_line[*bg_scroll_x], num_pixels_before_wrap);
+            memcpy(&line_buffer[num_pixels_before_wrap], bitmap_line, SCREEN_WIDTH - num_pixels_before_wrap);
+        }
+    }
+    
+    /* window */
+    if (((*lcdc) & LCDC_WINDOW_ENABLED) && window_line >= 0 && window_offset_x < SCREEN_WIDTH) {
+        uint16_t tile_map_address_space = ((*lcdc) & LCDC_WINDOW_TILE_MAP_SELECT) ? 0x9c00 : 0x9800;
+        uint8_t *bitmap_line = update_bg_bitmap_row(tile_map_address_space, window_line / TILE_HEIGHT)->pixels[window_line];
+        
+        if (window_offset_x < 0) memcpy(line_buffer, &bitmap_line[-window_offset_x], SCREEN_WIDTH);
+        else memcpy(&line_buffer[window_offset_x], bitmap_line, SCREEN_WIDTH - window_offset_x);
+    }
+    
+    /* apply the palette */
+    {
+        uint8_t shades[8];
+        uint8_t pixel_index;
+        
+        set_palette(*bg_palette);
+        
+        shades[4] = shade_0;
+        shades[1] = shade_1;
+        shades[2] = shade_2;
+        shades[3] = shade_3;
+        
+        for (pixel_index = 0; pixel_index < SCREEN_WIDTH; pixel_index++) {
+            line_buffer[pixel_index] = shades[line_buffer[pixel_index]];
+        }
+    }
+}
+
+/* Sprites are binned into per-line lists whenever OAM changes, rather than scanning all 40
+OAM entries on every line. Each list holds at most MAX_OBJECTS_PER_LINE entries, chosen in OAM
+order like the hardware does, and is sorted so that the highest-priority object comes first. */
+#define OAM_ADDRESS 0xfe00
+#define OAM_OBJECT_COUNT 40
+#define NUM_BYTES_PER_OBJECT 4
+#define MAX_OBJECTS_PER_LINE 10
+
+/* Where the renderer reads OAM from: robingb_memory, or the render queue's snapshot of it. */
+static const uint8_t *oam = &robingb_memory[OAM_ADDRESS];
+
+/* Bumped by the emulation whenever OAM changes. Each line captures it, and the renderer
+rebuilds the index when a line comes with a different version. */
+static uint32_t oam_version = 1;
+
+static struct {
+    uint32_t oam_version; /* that the index was built from */
+    uint8_t object_height;
+    uint8_t counts[SCREEN_HEIGHT];
+    uint8_t objects[SCREEN_HEIGHT][MAX_OBJECTS_PER_LINE]; /* OAM indices, highest priority first */
+} object_index = { 0, 0, {0}, {{0}} };
+
+void robingb_invalidate_object_index() {
+    snapshot_is_outdated = true;
+    if (robingb_objects_are_supported) oam_version++;
+}
+
+static void build_object_index(uint8_t object_height) {
+    uint8_t object;
+    
+    memset(object_index.counts, 0, SCREEN_HEIGHT);
+    
+    for (object = 0; object < OAM_OBJECT_COUNT; object++) {
+        const uint8_t *attributes = &oam[object*NUM_BYTES_PER_OBJECT];
+        int16_t translate_y = attributes[0] - TILE_HEIGHT*2;
+        
+        int16_t line_start = translate_y < 0 ? 0 : translate_y;
+        int16_t line_end = translate_y + object_height;
+        int16_t line;
+        
+        if (line_end > SCREEN_HEIGHT) line_end = SCREEN_HEIGHT;
+        
+        for (line = line_start; line < line_end; line++) {
+            uint8_t *line_objects = object_index.objects[line];
+            uint8_t count = object_index.counts[line];
+            uint8_t slot = count;
             
-            if (choose_palette_1) set_palette(*object_palette_1);
-            else set_palette(*object_palette_0);
+            if (count >= MAX_OBJECTS_PER_LINE) continue;
             
-            uint8_t tile_line[TILE_WIDTH];
-            {
-                int8_t tile_line_index = flip_y ? (translate_y+7 - *ly) : *ly - translate_y;
-                get_tile_line(0x8000, tile_data_index, tile_line_index, tile_line);
+            /* Insert in X order. Objects with equal X keep OAM order, as lower OAM indices win. */
+            while (slot > 0 && oam[line_objects[slot-1]*NUM_BYTES_PER_OBJECT + 1] > attributes[1]) {
+                line_objects[slot] = line_objects[slot-1];
+                slot--;
             }
             
-            uint8_t screen_x_start = translate_x < 0 ? 0 : translate_x;
-            uint8_t screen_x_end = translate_x + TILE_WIDTH;
+            line_objects[slot] = object;
+            object_index.counts[line] = count + 1;
+        }
+    }
+    
+    object_index.object_height = object_height;
+    object_index.oam_version = line_state.oam_version;
+}
+
+static uint8_t update_object_index() {
+    uint8_t object_height = 8;
+    if ((*lcdc) & LCDC_DOUBLE_HEIGHT_OBJECTS) object_height = 16;
+    
+    if (object_index.oam_version != line_state.oam_version || object_index.object_height != object_height) {
+        build_object_index(object_height);
+    }
+    
+    return object_height;
+}
+
+static void render_objects() {
+    uint8_t object_height = update_object_index();
+    
+    uint8_t *screen_line = line_buffer;
+    uint8_t *line_objects = object_index.objects[*ly];
+    
+    /* Draw the lowest-priority object first so that higher-priority objects end up on top. */
+    int8_t line_object;
+    for (line_object = object_index.counts[*ly] - 1; line_object >= 0; line_object--) {
+        const uint8_t *attributes = &oam[line_objects[line_object]*NUM_BYTES_PER_OBJECT];
+        int16_t translate_y = attributes[0] - TILE_HEIGHT*2;
+        
+        int16_t translate_x = attributes[1] - TILE_WIDTH;
+        
+        uint8_t tile_data_index = attributes[2];
+        
+        uint8_t object_flags = attributes[3];
+        bool choose_palette_1 = object_flags & robingb_bit(4);
+        bool flip_x = object_flags & robingb_bit(5);
+        bool flip_y = object_flags & robingb_bit(6);
+        bool behind_background = object_flags & robingb_bit(7);
+        
+        uint8_t tile_line[TILE_WIDTH];
+        uint8_t screen_x_start = translate_x < 0 ? 0 : translate_x;
+        int16_t screen_x_end = translate_x + TILE_WIDTH;
+        
+        /* ignore the lowest bit of the index if in double-height mode */
+        if (object_height > 8) tile_data_index &= 0xfe;
+        
+        if (choose_palette_1) set_palette(*object_palette_1);
+        else set_palette(*object_palette_0);
+        
+        {
+            int8_t tile_line_index = flip_y ? (translate_y+7 - *ly) : *ly - translate_y;
+            get_tile_line(0x8000, tile_data_index, tile_line_index, tile_line);
+        }
+        
+        if (screen_x_end > SCREEN_WIDTH) screen_x_end = SCREEN_WIDTH; /* don't spill into the next line */
+        
+        if (flip_x) {
+            uint8_t tile_pixel_index = translate_x < 0 ? (TILE_WIDTH-1)+translate_x : (TILE_WIDTH-1);
             
-            if (flip_x) {
-                uint8_t tile_pixel_index = translate_x < 0 ? (TILE_WIDTH-1)+translate_x : (TILE_WIDTH-1);
-                
-                if (behind_background) {
-                    uint8_t screen_x;
-                    for (screen_x = screen_x_start; screen_x < screen_x_end; screen_x++) {
-                        uint8_t tile_pixel = tile_line[tile_pixel_index--];
-                        
-                        if (!(tile_pixel & SHADE_0_FLAG) && screen_line[screen_x] & SHADE_0_FLAG) {
-                            screen_line[screen_x] = tile_pixel;
-                        }
-                    }
-                } else {
-                    uint8_t screen_x;
-                    for (screen_x = screen_x_start; screen_x < screen_x_end; screen_x++) {
-                        uint8_t tile_pixel = tile_line[tile_pixel_index--];
-                        
-                        if (!(tile_pixel & SHADE_0_FLAG)) {
-                            screen_line[screen_x] = tile_pixel;
-                        }
+            if (behind_background) {
+                uint8_t screen_x;
+                for (screen_x = screen_x_start; screen_x < screen_x_end; screen_x++) {
+                    uint8_t tile_pixel = tile_line[tile_pixel_index--];
+                    
+                    if (!(tile_pixel & SHADE_0_FLAG) && screen_line[screen_x] & SHADE_0_FLAG) {
+                        screen_line[screen_x] = tile_pixel;
                     }
                 }
             } else {
-                uint8_t tile_pixel_index = translate_x < 0 ? -translate_x : 0;
-                
-                if (behind_background) {
-                    uint8_t screen_x;
-                    for (screen_x = screen_x_start; screen_x < screen_x_end; screen_x++) {
-                        uint8_t tile_pixel = tile_line[tile_pixel_index++];
-                        
-                        if (!(tile_pixel & SHADE_0_FLAG) && screen_line[screen_x] & SHADE_0_FLAG) {
-                            screen_line[screen_x] = tile_pixel;
-                        }
+                uint8_t screen_x;
+                for (screen_x = screen_x_start; screen_x < screen_x_end; screen_x++) {
+                    uint8_t tile_pixel = tile_line[tile_pixel_index--];
+                    
+                    if (!(tile_pixel & SHADE_0_FLAG)) {
+                        screen_line[screen_x] = tile_pixel;
                     }
-                } else {
-                    uint8_t screen_x;
-                    for (screen_x = screen_x_start; screen_x < screen_x_end; screen_x++) {
-                        uint8_t tile_pixel = tile_line[tile_pixel_index++];
-                        
-                        if (!(tile_pixel & SHADE_0_FLAG)) {
-                            screen_line[screen_x] = tile_pixel;
-                        }
+                }
+            }
+        } else {
+            uint8_t tile_pixel_index = translate_x < 0 ? -translate_x : 0;
+            
+            if (behind_background) {
+                uint8_t screen_x;
+                for (screen_x = screen_x_start; screen_x < screen_x_end; screen_x++) {
+                    uint8_t tile_pixel = tile_line[tile_pixel_index++];
+                    
+                    if (!(tile_pixel & SHADE_0_FLAG) && screen_line[screen_x] & SHADE_0_FLAG) {
+                        screen_line[screen_x] = tile_pixel;
+                    }
+                }
+            } else {
+                uint8_t screen_x;
+                for (screen_x = screen_x_start; screen_x < screen_x_end; screen_x++) {
+                    uint8_t tile_pixel = tile_line[tile_pixel_index++];
+                    
+                    if (!(tile_pixel & SHADE_0_FLAG)) {
+                        screen_line[screen_x] = tile_pixel;
                     }
                 }
             }
@@ -296,46 +634,475 @@ static void render_objects() {
     }
 }
 
-void robingb_render_screen_line() {
+/* Line signatures: a cheap hash of everything a line is rendered from (registers, the tile
+line data under the background, window and objects etc.), used to skip lines that would come
+out identical to what is already in the screen buffer. */
+static uint32_t line_signatures[SCREEN_HEIGHT];
+static uint8_t known_lines[SCREEN_HEIGHT/8]; /* lines with a valid signature */
+static uint8_t *signed_screen = NULL;
+
+/* Lines changed since robingb_get_changed_lines(). Unlike the signatures above, this is only
+used by the emulation thread, which collects it from the render queue. */
+static uint8_t changed_lines[SCREEN_HEIGHT/8];
+
+static void mark_line_as_changed(uint8_t line) {
+    changed_lines[line/8] |= robingb_bit(line%8);
+}
+
+static void reclaim_rendered_lines();
+
+static uint32_t mix_signature(uint32_t signature, uint16_t value) {
+    return (signature ^ value) * 16777619;
+}
+
+static uint16_t get_tile_line_data(uint16_t tile_bank_address, int16_t tile_index, uint8_t tile_line_index) {
+    uint16_t tile_address = tile_bank_address + tile_index*NUM_BYTES_PER_TILE;
+    const uint8_t *bytes = &vram[tile_address + tile_line_index*NUM_BYTES_PER_TILE_LINE - VRAM_ADDRESS];
+    return bytes[0] | (bytes[1] << 8);
+}
+
+static uint16_t get_bg_tile_line_data(uint8_t coord_x, uint8_t coord_y, uint16_t tile_map_address_space, uint16_t tile_data_bank_address, uint8_t tile_line_index) {
+    int16_t tile_data_index = vram[tile_map_address_space + coord_x + coord_y*NUM_TILES_PER_BG_LINE - VRAM_ADDRESS];
+    if (tile_data_bank_address == 0x9000) tile_data_index = (int8_t)tile_data_index;
+    return get_tile_line_data(tile_data_bank_address, tile_data_index, tile_line_index);
+}
+
+static uint32_t calculate_line_signature() {
+    uint32_t signature = 2166136261u;
+    
+    signature = mix_signature(signature, *lcdc);
+    signature = mix_signature(signature, robingb_native_pixel_format);
     
     if ((*lcdc) & LCDC_BG_AND_WINDOW_ENABLED) {
-        set_palette(*bg_palette);
+        uint16_t tile_data_address_space = ((*lcdc) & LCDC_BG_AND_WINDOW_TILE_DATA_SELECT) ? 0x8000 : 0x9000;
+        int16_t window_line = (*ly) - (*window_offset_y);
         
-        render_background_line();
+        signature = mix_signature(signature, *bg_palette);
         
-        if ((*lcdc) & LCDC_WINDOW_ENABLED) render_window_line();
+        /* background: the 21 tiles that can be visible, plus the fine scroll offset */
+        {
+            uint8_t bg_y = *ly + *bg_scroll_y;
+            uint8_t tilegrid_y = bg_y / TILE_HEIGHT;
+            uint16_t tile_map_address_space = ((*lcdc) & LCDC_BG_TILE_MAP_SELECT) ? 0x9c00 : 0x9800;
+            uint8_t tilegrid_x;
+            
+            signature = mix_signature(signature, *bg_scroll_x);
+            
+            for (tilegrid_x = 0; tilegrid_x <= SCREEN_WIDTH/TILE_WIDTH; tilegrid_x++) {
+                uint8_t coord_x = ((*bg_scroll_x)/TILE_WIDTH + tilegrid_x) % NUM_TILES_PER_BG_LINE;
+                signature = mix_signature(signature, get_bg_tile_line_data(coord_x, tilegrid_y, tile_map_address_space, tile_data_address_space, bg_y % TILE_HEIGHT));
+            }
+        }
+        
+        /* window */
+        if (((*lcdc) & LCDC_WINDOW_ENABLED) && window_line >= 0) {
+            uint16_t tile_map_address_space = ((*lcdc) & LCDC_WINDOW_TILE_MAP_SELECT) ? 0x9c00 : 0x9800;
+            int16_t num_pixels_to_render = SCREEN_WIDTH - ((*window_offset_x_plus_7) - 7);
+            int16_t tilegrid_x;
+            
+            signature = mix_signature(signature, *window_offset_x_plus_7);
+            signature = mix_signature(signature, window_line);
+            
+            for (tilegrid_x = 0; tilegrid_x*TILE_WIDTH < num_pixels_to_render; tilegrid_x++) {
+                signature = mix_signature(signature, get_bg_tile_line_data(tilegrid_x, window_line / TILE_HEIGHT, tile_map_address_space, tile_data_address_space, window_line % TILE_HEIGHT));
+            }
+        }
+    }
+    
+    if (robingb_objects_are_supported && ((*lcdc) & LCDC_OBJECTS_ENABLED)) {
+        uint8_t object_height = update_object_index();
+        uint8_t *line_objects = object_index.objects[*ly];
+        
+        uint8_t line_object;
+        for (line_object = 0; line_object < object_index.counts[*ly]; line_object++) {
+            const uint8_t *attributes = &oam[line_objects[line_object]*NUM_BYTES_PER_OBJECT];
+            uint8_t tile_data_index = attributes[2];
+            uint8_t tile_line_index = *ly - (attributes[0] - TILE_HEIGHT*2);
+            
+            if (object_height > 8) tile_data_index &= 0xfe;
+            if (attributes[3] & robingb_bit(6)) tile_line_index = (TILE_HEIGHT-1) - tile_line_index; /* as in render_objects() */
+            
+            signature = mix_signature(signature, attributes[0]);
+            signature = mix_signature(signature, attributes[1]);
+            signature = mix_signature(signature, attributes[3]);
+            signature = mix_signature(signature, (attributes[3] & robingb_bit(4)) ? *object_palette_1 : *object_palette_0);
+            signature = mix_signature(signature, get_tile_line_data(0x8000, tile_data_index, tile_line_index));
+        }
+    }
+    
+    return signature;
+}
+
+/* Returns true if the current line needs rendering. */
+static bool line_has_changed() {
+    uint32_t signature;
+    uint8_t line_byte = (*ly) / 8;
+    uint8_t line_bit = robingb_bit((*ly) % 8);
+    
+    if (line_state.screen != signed_screen) {
+        /* A different buffer was passed in, so nothing in it can be relied upon. */
+        memset(known_lines, 0x00, sizeof(known_lines));
+        signed_screen = line_state.screen;
+    }
+    
+    signature = calculate_line_signature();
+    
+    if ((known_lines[line_byte] & line_bit) && line_signatures[*ly] == signature) return false;
+    
+    line_signatures[*ly] = signature;
+    known_lines[line_byte] |= line_bit;
+    return true;
+}
+
+bool robingb_get_changed_lines(uint8_t changed_lines_out[]) {
+    bool any_line_changed = false;
+    uint8_t i;
+    
+    if (!robingb_skip_unchanged_lines) {
+        memset(changed_lines_out, 0xff, sizeof(changed_lines));
+        return true;
+    }
+    
+    reclaim_rendered_lines();
+    
+    for (i = 0; i < sizeof(changed_lines); i++) {
+        changed_lines_out[i] = changed_lines[i];
+        if (changed_lines[i]) any_line_changed = true;
+    }
+    
+    memset(changed_lines, 0x00, sizeof(changed_lines));
+    return any_line_changed;
+}
+
+/* Renders the line in line_state, and returns false if it was skipped as unchanged. */
+static bool render_line() {
+    
+    if (robingb_skip_unchanged_lines && !line_has_changed()) return false;
+    
+    if ((*lcdc) & LCDC_BG_AND_WINDOW_ENABLED) {
+        if (bg_cache.bitmaps) {
+            render_cached_background_and_window_line();
+        } else {
+            set_palette(*bg_palette);
+            
+            render_background_line();
+            
+            if ((*lcdc) & LCDC_WINDOW_ENABLED) render_window_line();
+        }
     } else {
         /* Background is disabled, so just render white */
-        memset(&robingb_screen[(*ly)*SCREEN_WIDTH], 0x00, SCREEN_WIDTH);
+        memset(line_buffer, 0x00, SCREEN_WIDTH);
     }
     
     /* check if object drawing is enabled */
-    if ((*lcdc) & LCDC_OBJECTS_ENABLED) render_objects();
+    if (robingb_objects_are_supported && ((*lcdc) & LCDC_OBJECTS_ENABLED)) render_objects();
     
-    /* convert from game boy 2-bit to target 8-bit */
+    /* convert from game boy 2-bit to the target pixel format */
     {
-        uint16_t pixel_index;
-        uint16_t screen_line_start = (*ly)*SCREEN_WIDTH;
-        uint16_t screen_line_end = screen_line_start + SCREEN_WIDTH;
+        uint8_t pixel_index;
+        uint8_t *output_line;
         
-        if (robingb_native_pixel_format) {
-            /* The '& 0x03' below is to discard the SHADE_0_FLAG bit,
-            which has already served its purpose in render_objects(). */
-            
-            for (pixel_index = screen_line_start; pixel_index < screen_line_end; pixel_index++) {
-                robingb_screen[pixel_index] &= 0x03;
-            }
-        } else {
-            for (pixel_index = screen_line_start; pixel_index < screen_line_end; pixel_index++) {
-                robingb_screen[pixel_index] = ((robingb_screen[pixel_index] & 0x03) - 3) * -85;
-            }
+        if (line_sink.line_ready) output_line = line_sink.buffer;
+        else output_line = &line_state.screen[(*ly) * line_sizes[pixel_format]];
+        
+        switch (pixel_format) {
+            case ROBINGB_PIXEL_FORMAT_8BIT: {
+                const uint8_t *lut = robingb_native_pixel_format ? native_lut : grey_lut;
+                uint8_t *screen_line = output_line;
+                
+                for (pixel_index = 0; pixel_index < SCREEN_WIDTH; pixel_index++) {
+                    screen_line[pixel_index] = lut[line_buffer[pixel_index]];
+                }
+            } break;
+            case ROBINGB_PIXEL_FORMAT_RGB565: {
+                uint16_t *screen_line = (uint16_t*)output_line;
+                
+                for (pixel_index = 0; pixel_index < SCREEN_WIDTH; pixel_index++) {
+                    screen_line[pixel_index] = rgb565_lut[line_buffer[pixel_index]];
+                }
+            } break;
+            case ROBINGB_PIXEL_FORMAT_XRGB8888: {
+                uint32_t *screen_line = (uint32_t*)output_line;
+                
+                for (pixel_index = 0; pixel_index < SCREEN_WIDTH; pixel_index++) {
+                    screen_line[pixel_index] = xrgb8888_lut[line_buffer[pixel_index]];
+                }
+            } break;
+            case ROBINGB_PIXEL_FORMAT_2BPP: {
+                /* 4 pixels per byte, leftmost pixel in the highest 2 bits */
+                uint8_t *screen_line = output_line;
+                
+                for (pixel_index = 0; pixel_index < SCREEN_WIDTH; pixel_index += 4) {
+                    screen_line[pixel_index/4] =
+                        (native_lut[line_buffer[pixel_index]] << 6)
+                        | (native_lut[line_buffer[pixel_index+1]] << 4)
+                        | (native_lut[line_buffer[pixel_index+2]] << 2)
+                        | native_lut[line_buffer[pixel_index+3]];
+                }
+            } break;
+            default: assert(false); break;
         }
+        
+        if (line_sink.line_ready) line_sink.buffer = line_sink.line_ready(*ly, output_line);
+    }
+    
+    return true;
+}
+
+static bool colors_are_set = false;
+
+static void set_colors(const uint32_t colors[]) {
+    static const uint32_t default_colors[4] = { 0xffffff, 0xaaaaaa, 0x555555, 0x000000 };
+    uint8_t i;
+    
+    if (colors == NULL) colors = default_colors;
+    
+    for (i = 0; i < 8; i++) {
+        uint32_t color = colors[i & 0x03];
+        xrgb8888_lut[i] = color & 0xffffff;
+        rgb565_lut[i] = ((color >> 8) & 0xf800) | ((color >> 5) & 0x07e0) | ((color >> 3) & 0x001f);
     }
+    
+    colors_are_set = true;
+}
+
+void robingb_render_init() {
+    /* With ROBINGB_FIXED_PIXEL_FORMAT, the host may never call robingb_set_pixel_format(),
+    so the colors must be ready without it. Colors the host has already set are kept. */
+    if (!colors_are_set) set_colors(NULL);
+}
+
+void robingb_set_pixel_format(RobinGB_Pixel_Format format, const uint32_t colors[]) {
+    set_colors(colors);
+    
+#ifdef ROBINGB_FIXED_PIXEL_FORMAT
+    assert(format == pixel_format); /* RobinGB was built for a single pixel format */
+    (void)format;
+#else
+    pixel_format = format;
+#endif
+    
+    /* Nothing in the screen buffer can be relied upon after a format change. */
+    memset(known_lines, 0x00, sizeof(known_lines));
+}
+
+static void capture_line_state(Line_State *state_out) {
+    state_out->screen = robingb_screen;
+    state_out->oam_version = oam_version;
+    state_out->ly = robingb_memory[LCD_LY_ADDRESS];
+    state_out->lcdc = robingb_memory[LCD_CONTROL_ADDRESS];
+    state_out->bg_palette = robingb_memory[0xff47];
+    state_out->object_palette_0 = robingb_memory[0xff48];
+    state_out->object_palette_1 = robingb_memory[0xff49];
+    state_out->bg_scroll_y = robingb_memory[0xff42];
+    state_out->bg_scroll_x = robingb_memory[0xff43];
+    state_out->window_offset_y = robingb_memory[0xff4a];
+    state_out->window_offset_x_plus_7 = robingb_memory[0xff4b];
 }
 
+/* ----------------------------------------------- */
+/* Render queue                                    */
+/* ----------------------------------------------- */
 
+/* When the render queue is enabled, robingb_render_screen_line() only captures the line's
+registers into a single-producer/single-consumer queue, and the host renders the queued lines
+on another thread or core with robingb_render_queued_line().
 
+The queued lines are rendered from a snapshot of VRAM and OAM rather than the live memory, so
+the emulation never waits for the render thread. A new snapshot is taken at the first line
+after a VRAM or OAM write, and a snapshot is reused once every line queued with it has been
+rendered. Most games only write to VRAM and OAM during V-blank, so that's one snapshot per
+frame. If the queue or every snapshot is full, the line is dropped instead, which is also what
+happens when there's no render thread at all.
 
+Each counter is only written by one thread, and is published with store_release() after the
+data it covers. */
+#define RENDER_QUEUE_LENGTH 256 /* must be a power of 2 */
+#define NUM_SNAPSHOTS 4
 
+typedef struct {
+    uint8_t vram[VRAM_SIZE];
+    uint8_t oam[OAM_OBJECT_COUNT*NUM_BYTES_PER_OBJECT];
+    Vram_Changes changes; /* since the previous snapshot, for the background cache */
+    uint32_t serial;
+    uint16_t num_queued_lines; /* not yet reclaimed by the emulation thread */
+} Snapshot;
 
+typedef struct {
+    Line_State state;
+    uint8_t snapshot;
+    bool was_changed; /* written by the render thread */
+} Queued_Line;
+
+static struct {
+    bool is_enabled;
+    Queued_Line lines[RENDER_QUEUE_LENGTH];
+    Snapshot *snapshots; /* NULL while the queue is disabled */
+    
+    /* only used by the emulation thread */
+    int8_t current_snapshot; /* -1 if there is none */
+    uint32_t num_snapshots_taken;
+    uint16_t num_reclaimed;
+    uint32_t num_dropped_lines;
+    
+    /* only used by the render thread */
+    uint32_t rendered_snapshot_serial;
+    
+    volatile uint16_t num_pushed; /* only written by the emulation thread */
+    volatile uint16_t num_rendered; /* only written by the render thread */
+} render_queue;
+
+/* GCC and Clang have acquire/release operations built in, which thread sanitizers understand.
+Elsewhere, a full barrier does the same job. */
+static uint16_t load_acquire(volatile uint16_t *counter) {
+#if defined(__GNUC__) && !defined(ROBINGB_SINGLE_THREADED)
+    return __atomic_load_n(counter, __ATOMIC_ACQUIRE);
+#else
+    uint16_t value = *counter;
+    robingb_memory_barrier();
+    return value;
+#endif
+}
 
+static void store_release(volatile uint16_t *counter, uint16_t value) {
+#if defined(__GNUC__) && !defined(ROBINGB_SINGLE_THREADED)
+    __atomic_store_n(counter, value, __ATOMIC_RELEASE);
+#else
+    robingb_memory_barrier();
+    *counter = value;
+#endif
+}
+
+bool robingb_render_queued_line() {
+    uint16_t num_rendered = render_queue.num_rendered;
+    Queued_Line *queued_line;
+    Snapshot *snapshot;
+    
+    if (num_rendered == load_acquire(&render_queue.num_pushed)) return false;
+    
+    queued_line = &render_queue.lines[num_rendered % RENDER_QUEUE_LENGTH];
+    snapshot = &render_queue.snapshots[queued_line->snapshot];
+    
+    if (snapshot->serial != render_queue.rendered_snapshot_serial) {
+        vram = snapshot->vram;
+        oam = snapshot->oam;
+        apply_vram_changes(&snapshot->changes);
+        render_queue.rendered_snapshot_serial = snapshot->serial;
+    }
+    
+    line_state = queued_line->state;
+    queued_line->was_changed = render_line();
+    
+    store_release(&render_queue.num_rendered, num_rendered + 1);
+    return true;
+}
+
+bool robingb_render_queue_is_empty() {
+    return load_acquire(&render_queue.num_rendered) == render_queue.num_pushed;
+}
+
+uint32_t robingb_get_num_dropped_lines() {
+    return render_queue.num_dropped_lines;
+}
+
+/* Collects the results of rendered lines, and frees the snapshots they were rendered from. */
+static void reclaim_rendered_lines() {
+    uint16_t num_rendered;
+    
+    if (!render_queue.is_enabled) return;
+    
+    num_rendered = load_acquire(&render_queue.num_rendered);
+    
+    while (render_queue.num_reclaimed != num_rendered) {
+        Queued_Line *queued_line = &render_queue.lines[render_queue.num_reclaimed % RENDER_QUEUE_LENGTH];
+        
+        if (queued_line->was_changed) mark_line_as_changed(queued_line->state.ly);
+        render_queue.snapshots[queued_line->snapshot].num_queued_lines--;
+        
+        render_queue.num_reclaimed++;
+    }
+}
+
+static bool take_snapshot() {
+    Snapshot *snapshot;
+    int8_t s;
+    
+    for (s = 0; s < NUM_SNAPSHOTS; s++) {
+        if (s != render_queue.current_snapshot && render_queue.snapshots[s].num_queued_lines == 0) break;
+    }
+    
+    if (s == NUM_SNAPSHOTS) return false;
+    
+    snapshot = &render_queue.snapshots[s];
+    memcpy(snapshot->vram, &robingb_memory[VRAM_ADDRESS], VRAM_SIZE);
+    memcpy(snapshot->oam, &robingb_memory[OAM_ADDRESS], sizeof(snapshot->oam));
+    snapshot->changes = pending_vram_changes;
+    snapshot->serial = ++render_queue.num_snapshots_taken;
+    
+    memset(&pending_vram_changes, 0x00, sizeof(pending_vram_changes));
+    render_queue.current_snapshot = s;
+    snapshot_is_outdated = false;
+    return true;
+}
+
+static void queue_screen_line() {
+    uint16_t num_pushed;
+    Queued_Line *queued_line;
+    
+    reclaim_rendered_lines();
+    
+    num_pushed = render_queue.num_pushed;
+    
+    if ((uint16_t)(num_pushed - render_queue.num_reclaimed) >= RENDER_QUEUE_LENGTH
+        || (snapshot_is_outdated && !take_snapshot())) {
+        render_queue.num_dropped_lines++;
+        return;
+    }
+    
+    queued_line = &render_queue.lines[num_pushed % RENDER_QUEUE_LENGTH];
+    capture_line_state(&queued_line->state);
+    queued_line->snapshot = render_queue.current_snapshot;
+    render_queue.snapshots[render_queue.current_snapshot].num_queued_lines++;
+    
+    store_release(&render_queue.num_pushed, num_pushed + 1);
+}
+
+bool robingb_set_render_queue(bool enabled) {
+    if (enabled && !render_queue.is_enabled) {
+        render_queue.snapshots = (Snapshot*)calloc(NUM_SNAPSHOTS, sizeof(Snapshot));
+        if (!render_queue.snapshots) return false;
+        
+        render_queue.current_snapshot = -1;
+        render_queue.rendered_snapshot_serial = 0;
+        snapshot_is_outdated = true;
+        render_queue.is_enabled = true;
+    } else if (!enabled && render_queue.is_enabled) {
+        /* The host has stopped its render thread, so finish the remaining lines here. */
+        while (robingb_render_queued_line()) {}
+        reclaim_rendered_lines();
+        
+        free(render_queue.snapshots);
+        render_queue.snapshots = NULL;
+        render_queue.is_enabled = false;
+        
+        vram = &robingb_memory[VRAM_ADDRESS];
+        oam = &robingb_memory[OAM_ADDRESS];
+    }
+    
+    return true;
+}
+
+void robingb_render_screen_line() {
+    if (render_queue.is_enabled) {
+        queue_screen_line();
+    } else {
+        capture_line_state(&line_state);
+        
+        if (pending_vram_changes.any_cell_is_dirty || pending_vram_changes.any_tile_is_dirty) {
+            apply_vram_changes(&pending_vram_changes);
+            memset(&pending_vram_changes, 0x00, sizeof(pending_vram_changes));
+        }
+        
+        if (render_line()) mark_line_as_changed(line_state.ly);
+    }
+}
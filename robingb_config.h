@@ -0,0 +1,51 @@
+#ifndef ROBINGB_CONFIG_H
+#define ROBINGB_CONFIG_H
+
+/*
+Compile-time configuration. Everything is enabled by default, which suits desktops and
+servers. On small targets, uncomment the options below (or define them on the compiler's
+command line) to build RobinGB without the features you don't need. Disabled features are
+removed by the compiler, so they cost no cycles and no flash.
+*/
+
+/* Leave out audio synthesis. The audio registers still behave correctly for the game,
+and the audio functions in RobinGB.h only return silence. */
+/* #define ROBINGB_DISABLE_AUDIO */
+
+/* Only build the renderer for one RobinGB_Pixel_Format, e.g. ROBINGB_PIXEL_FORMAT_RGB565.
+That format is used from the start, and robingb_set_pixel_format() must only be called
+with it (it can still set the colors). */
+/* #define ROBINGB_FIXED_PIXEL_FORMAT ROBINGB_PIXEL_FORMAT_8BIT */
+
+/* Never draw objects (sprites). Saves about 1.6KB of RAM, but most games need them. */
+/* #define ROBINGB_DISABLE_OBJECTS */
+
+/* Leave out support for MBC1 carts, so that only 32KB ROM-only carts can be played. Reads
+from ROM skip the bank check. */
+/* #define ROBINGB_DISABLE_MBC1 */
+
+/* Don't mirror writes between 0xc000-0xddff and its echo at 0xe000-0xfdff. Games almost
+never use the echo, and this makes every write to work RAM cheaper. */
+/* #define ROBINGB_DISABLE_ECHO_RAM */
+
+/* Strip all assert()s and log output out of RobinGB. */
+/* #define ROBINGB_DISABLE_ASSERTS */
+/* #define ROBINGB_DISABLE_LOGGING */
+
+/* Promise that all of RobinGB's functions are called from one thread, including the audio
+and render queue functions. The memory barriers between threads are then left out, which
+is needed on compilers that RobinGB doesn't know a barrier for. */
+/* #define ROBINGB_SINGLE_THREADED */
+
+/* Count statistics about the emulation, such as robingb_get_fusion_stats(). */
+/* #define ROBINGB_ENABLE_INSTRUMENTATION */
+
+/* Sample where the emulated CPU spends its cycles, by opcode and by instruction address,
+for robingb_write_profile() and friends. Costs about 24KB of RAM and a few percent of speed. */
+/* #define ROBINGB_ENABLE_PROFILER */
+
+/* Generate all 256 CB-prefixed opcodes as separate cases instead of decoding them. A
+little faster on some hosts, but about 12KB bigger. */
+/* #define ROBINGB_UNROLLED_CB_OPCODES */
+
+#endif /* end include guard */
@@ -26,13 +26,29 @@ uint8_t robingb_romb_read_switchable_bank(uint16_t address) {
 	}
 }
 
+/* Returns the number of the ROM bank currently mapped at 0x4000. */
+int16_t robingb_romb_get_switchable_bank_number() {
+	return robingb_romb_current_switchable_bank;
+}
+
+/* Returns the start of the current switchable bank, which appears at 0x4000. */
+uint8_t *robingb_romb_get_switchable_bank() {
+	if (robingb_romb_current_switchable_bank == 1) {
+		return &robingb_memory[BANK_SIZE];
+	} else {
+		return cached_banks[robingb_romb_current_switchable_bank-2].data;
+	}
+}
+
 void robingb_romb_init_first_banks() {
 	/* Load ROM banks 0 and 1 */
-	printf("Loading the first 2 ROM banks...\n");
+	robingb_log("Loading the first 2 ROM banks...\n");
 	bool success = robingb_read_file(robingb_cart_path, 0, BANK_SIZE*2, robingb_memory);
 	assert(success);
+	(void)success; /* only used by the assert */
 	robingb_romb_current_switchable_bank = 1;
-	printf("Done\n");
+	robingb_invalidate_fetch_region();
+	robingb_log("Done\n");
 }
 
 void robingb_romb_init_additional_banks() {
@@ -46,36 +62,37 @@ void robingb_romb_init_additional_banks() {
 			case 0x52: total_bank_count = 72; break;
 			case 0x53: total_bank_count = 80; break;
 			case 0x54: total_bank_count = 96; break;
-			default: assert(false); break;
+			default: assert(false); total_bank_count = 2; break; /* with asserts disabled, only use the first 2 banks */
 		}
 	}
 	
-	printf("Cart has a total of %i ROM banks\n", total_bank_count);
+	robingb_log("Cart has a total of %i ROM banks\n", total_bank_count);
 	
 	if (total_bank_count > 2) {
 		if (cached_banks) {
-			printf("free()ing previous ROM bank cache...\n");
+			robingb_log("free()ing previous ROM bank cache...\n");
 			free(cached_banks);
-			printf("Done\n");
+			robingb_log("Done\n");
 		}
 		
 		cached_bank_count = total_bank_count - 2;
 		
-		printf("Allocating %iKB for the remaining %i ROM banks...\n", cached_bank_count*BANK_SIZE/1024, cached_bank_count);
+		robingb_log("Allocating %iKB for the remaining %i ROM banks...\n", cached_bank_count*BANK_SIZE/1024, cached_bank_count);
 		
 		cached_banks = (Cached_Bank*)malloc(sizeof(uint8_t) * BANK_SIZE * cached_bank_count);
 		
 		assert(cached_banks);
-		printf("Done\n");
+		robingb_log("Done\n");
 		
-		printf("Loading the remaining %i ROM banks...\n", cached_bank_count);
+		robingb_log("Loading the remaining %i ROM banks...\n", cached_bank_count);
 		
 		uint32_t file_offset = BANK_SIZE * 2; /* Offset of 2, as the first 2 banks are already loaded */
 		
 		bool success = robingb_read_file(robingb_cart_path, file_offset, BANK_SIZE*cached_bank_count, (uint8_t*)cached_banks);
 		assert(success);
+		(void)success; /* only used by the assert */
 		
-		printf("Done\n");
+		robingb_log("Done\n");
 	} else cached_bank_count = 0;
 }
 
@@ -95,6 +112,7 @@ void robingb_romb_perform_bank_control(int address, uint8_t value, Mbc_Type mbc_
 				if (new_bank == 0x00 || new_bank == 0x20 || new_bank == 0x40 || new_bank == 0x60) new_bank++;
 				
 				robingb_romb_current_switchable_bank = new_bank;
+				robingb_invalidate_fetch_region();
 			} else if (address >= 0x4000 && address < 0x6000) {
 				/* Select bits 5+6 of ROM bank number */
 				
@@ -106,6 +124,7 @@ void robingb_romb_perform_bank_control(int address, uint8_t value, Mbc_Type mbc_
 				robingb_romb_current_switchable_bank &= ~bits_5_6_mask; /* wipe bits 5+6 */
 				
 				robingb_romb_current_switchable_bank |= value; /* set bits 5+6 to the new value */
+				robingb_invalidate_fetch_region();
 			} else assert(false);
 		} break;
 		case MBC_3: {
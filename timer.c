@@ -6,71 +6,129 @@
 #define MODULO_ADDRESS 0xff06 /* "TMA" */
 #define CONTROL_ADDRESS 0xff07 /* "TAC" */
 
-#define MINIMUM_CYCLES_PER_COUNTER_INCREMENT 16
+/* DIV and TIMA aren't updated as time passes. Instead they're calculated from
+robingb_cycle_count when they're read. The only scheduled work is TIMA's next overflow,
+which the core checks for after each instruction, so the timer costs nothing on
+instructions that don't use it. */
 
-static uint8_t *counter = &robingb_memory[COUNTER_ADDRESS];
 static uint8_t *modulo  = &robingb_memory[MODULO_ADDRESS];
 static uint8_t *control = &robingb_memory[CONTROL_ADDRESS]; /* Note, the upper 5 bits are undefined. */
 
-static uint16_t incrementer_every_cycle;
-static uint8_t *div_byte = ((uint8_t*)&incrementer_every_cycle) + 1;
+/* DIV is the upper byte of this many cycles ago. */
+static uint16_t divider_origin;
 
-static uint16_t cycles_since_last_tima_increment = 0;
+static struct {
+	uint32_t origin_cycle; /* the cycle of TIMA's most recent increment (if it's enabled) */
+	uint8_t origin_value; /* TIMA's value at origin_cycle */
+	uint8_t cycles_per_increment_shift;
+	uint16_t paused_phase; /* the number of cycles since the last increment, while TIMA is disabled */
+} tima;
+
+uint32_t robingb_timer_overflow_cycle;
+
+static bool timer_is_enabled() {
+	return (*control) & 0x04;
+}
+
+static uint8_t get_cycles_per_increment_shift() {
+	/* calculate cycles per TIMA increment from the lowest 2 bits */
+	switch ((*control) & 0x03) {
+		case 0x00: return 10; /* 1024 */
+		case 0x01: return 4; /* 16 */
+		case 0x02: return 6; /* 64 */
+		case 0x03: return 8; /* 256 */
+		default: assert(false); return 0;
+	}
+}
+
+static void schedule_overflow() {
+	if (timer_is_enabled()) {
+		robingb_timer_overflow_cycle =
+			tima.origin_cycle + ((256 - tima.origin_value) << tima.cycles_per_increment_shift);
+	} else {
+		/* Never, in practice. If it's reached, it's rescheduled. */
+		robingb_timer_overflow_cycle = robingb_cycle_count + 0x7fffffff;
+	}
+}
+
+/* Moves the origin forward to TIMA's most recent increment. An overflow can't be skipped
+here, because overflows are handled as soon as they're due. */
+static void catch_up_tima() {
+	uint32_t num_increments;
+	
+	if (!timer_is_enabled()) return;
+	
+	num_increments = (robingb_cycle_count - tima.origin_cycle) >> tima.cycles_per_increment_shift;
+	tima.origin_value += num_increments;
+	tima.origin_cycle += num_increments << tima.cycles_per_increment_shift;
+}
 
 void robingb_timer_init() {
-	incrementer_every_cycle = 0xabcc;
-	assert(*div_byte == 0xab);
-	robingb_memory[DIVIDER_ADDRESS] = *div_byte;
+	divider_origin = robingb_cycle_count - 0xabcc;
+	assert(robingb_timer_read_register(DIVIDER_ADDRESS) == 0xab);
 	
-	*counter = 0x00;
 	*modulo = 0x00;
 	*control = 0x00;
+	
+	tima.origin_cycle = robingb_cycle_count;
+	tima.origin_value = 0x00;
+	tima.cycles_per_increment_shift = get_cycles_per_increment_shift();
+	tima.paused_phase = 0;
+	schedule_overflow();
 }
 
-uint8_t robingb_respond_to_timer_div_register() {
-	return 0x00;
+void robingb_timer_handle_overflow() {
+	if (timer_is_enabled()) {
+		tima.origin_cycle = robingb_timer_overflow_cycle;
+		tima.origin_value = *modulo;
+		robingb_request_interrupt(INTERRUPT_FLAG_TIMER);
+	}
+	
+	schedule_overflow();
 }
 
-void robingb_timer_update(uint8_t num_cycles) {
-	
-	/* update incrementer and therefore DIV. */
-	incrementer_every_cycle += num_cycles;
-	robingb_memory[DIVIDER_ADDRESS] = *div_byte;
+uint8_t robingb_timer_read_register(uint16_t address) {
+	if (address == DIVIDER_ADDRESS) {
+		robingb_memory[address] = (uint16_t)(robingb_cycle_count - divider_origin) >> 8;
+	} else {
+		assert(address == COUNTER_ADDRESS);
+		catch_up_tima();
+		robingb_memory[address] = tima.origin_value;
+	}
 	
-	/* Update TIMA and potentially request an interrupt */
-	if ((*control) & 0x04 /* check if timer is enabled */) {
+	return robingb_memory[address];
+}
+
+void robingb_timer_respond_to_register_write(uint16_t address, uint8_t value) {
+	catch_up_tima();
 	
-		cycles_since_last_tima_increment += num_cycles;
-		
-		if (cycles_since_last_tima_increment >= MINIMUM_CYCLES_PER_COUNTER_INCREMENT) {
-			/* calculate actual cycles per TIMA increment from the lowest 2 bits */
-			uint16_t cycles_per_tima_increment;
-			switch ((*control) & 0x03) {
-				case 0x00: cycles_per_tima_increment = 1024; break;
-				case 0x01: cycles_per_tima_increment = 16; break;
-				case 0x02: cycles_per_tima_increment = 64; break;
-				case 0x03: cycles_per_tima_increment = 256; break;
-				default: assert(false); break;
-			}
+	switch (address) {
+		case DIVIDER_ADDRESS:
+			/* Any write resets DIV */
+			divider_origin = robingb_cycle_count;
+			robingb_memory[address] = 0x00;
+			return;
+		case COUNTER_ADDRESS:
+			tima.origin_value = value;
+			robingb_memory[address] = value;
+			break;
+		case MODULO_ADDRESS:
+			/* TMA is only used at the next overflow */
+			*modulo = value;
+			return;
+		case CONTROL_ADDRESS: {
+			/* Keep the progress towards the next increment, as far as the new frequency allows. */
+			uint32_t phase = timer_is_enabled() ? robingb_cycle_count - tima.origin_cycle : tima.paused_phase;
+			
+			*control = value;
+			tima.cycles_per_increment_shift = get_cycles_per_increment_shift();
+			phase &= (1 << tima.cycles_per_increment_shift) - 1;
 			
-			if (cycles_since_last_tima_increment >= cycles_per_tima_increment) {
-				uint8_t prev_tima = (*counter)++;
-				
-				/* check for overflow */
-				if (prev_tima > *counter) {
-					*counter = *modulo;
-					robingb_request_interrupt(INTERRUPT_FLAG_TIMER);
-				}
-				
-				cycles_since_last_tima_increment -= cycles_per_tima_increment;
-			}
-		}
+			if (timer_is_enabled()) tima.origin_cycle = robingb_cycle_count - phase;
+			else tima.paused_phase = phase;
+		} break;
+		default: assert(false); break;
 	}
+	
+	schedule_overflow();
 }
-
-
-
-
-
-
-